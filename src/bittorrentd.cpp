@@ -0,0 +1,377 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "download.h"
+#include "session.h"
+#include "timeline.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <vlc_common.h>
+#include <vlc_interrupt.h>
+#pragma GCC diagnostic pop
+
+#define D(x)
+
+struct DaemonOptions {
+    std::string save_path;
+    bool keep;
+    StorageMode storage_mode;
+    bool selective;
+};
+
+static DaemonReply
+handle(std::shared_ptr<Download>& dl, std::multiset<int>& files,
+    bool& paused, const DaemonRequest& req, char* shm,
+    const DaemonOptions& opts)
+{
+    DaemonReply rep = {};
+
+    if (req.type != DAEMON_HELLO && req.type != DAEMON_OPEN && !dl)
+        throw std::runtime_error("No download added");
+
+    switch (req.type) {
+    case DAEMON_HELLO:
+        break;
+    case DAEMON_OPEN: {
+        // Files open in the download being replaced
+        if (dl) {
+            if (paused)
+                dl->resume();
+            paused = false;
+
+            for (int file : files)
+                dl->close_file(file);
+            files.clear();
+        }
+
+        std::string md = req.text;
+        // Same torrent as another client gives the same download
+        dl = Download::get_download(&md[0], md.size(), opts.save_path,
+            opts.keep, opts.storage_mode, opts.selective);
+        break;
+    }
+    case DAEMON_GET_FILE: {
+        auto f = dl->get_file(req.text);
+        rep.value = f.first;
+        rep.extra = (int64_t) f.second;
+        break;
+    }
+    case DAEMON_READ:
+        rep.value = dl->read((int) req.file, req.off, shm,
+            (size_t) std::max(std::min(req.len, (int64_t) DAEMON_SHM_SIZE),
+                (int64_t) 0),
+            req.window, nullptr);
+        break;
+    case DAEMON_PREFETCH:
+        dl->prefetch((int) req.file, req.off, req.len);
+        break;
+    case DAEMON_PAUSE:
+        // Each pause() must be matched by one resume()
+        if (!paused)
+            dl->pause((int) req.file, req.off, req.window, (int) req.limit);
+        paused = true;
+        break;
+    case DAEMON_RESUME:
+        if (paused)
+            dl->resume();
+        paused = false;
+        break;
+    case DAEMON_STATS:
+        // Only the last client of a download gets them, as they cover all
+        if (dl.use_count() == 1)
+            rep.text = dl->get_stats();
+        break;
+    case DAEMON_RATE:
+        rep.value = dl->get_download_rate();
+        break;
+    case DAEMON_PEERS:
+        rep.value = dl->get_num_peers();
+        break;
+    case DAEMON_IS_LOCAL:
+        rep.value = dl->is_local((int) req.file, req.off, req.len) ? 1 : 0;
+        break;
+    case DAEMON_SIDECARS:
+        rep.value = dl->prefetch_sidecars((int) req.file);
+        break;
+    case DAEMON_OPEN_FILE:
+        dl->open_file((int) req.file);
+        files.insert((int) req.file);
+        break;
+    case DAEMON_CLOSE_FILE:
+        if (files.count((int) req.file)) {
+            dl->close_file((int) req.file);
+            files.erase(files.find((int) req.file));
+        }
+        break;
+    default:
+        throw std::runtime_error("Unknown request");
+    }
+
+    return rep;
+}
+
+static void
+serve(int fd, DaemonOptions opts)
+{
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, fd));
+
+    // Each client gets its own area, reads go straight into it
+    int shmfd = memfd_create("vlc-bittorrentd", MFD_CLOEXEC);
+    if (shmfd < 0 || ftruncate(shmfd, DAEMON_SHM_SIZE) < 0) {
+        std::cerr << "Failed to create shared memory: " << strerror(errno)
+                  << std::endl;
+        if (shmfd >= 0)
+            close(shmfd);
+        close(fd);
+        return;
+    }
+
+    void* shm = mmap(nullptr, DAEMON_SHM_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED, shmfd, 0);
+    if (shm == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory: " << strerror(errno)
+                  << std::endl;
+        close(shmfd);
+        close(fd);
+        return;
+    }
+
+    // Waits for pieces register with this, like in the plugin, so they can
+    // be given up when the client goes away
+    vlc_interrupt_t* intr = vlc_interrupt_create();
+    vlc_interrupt_set(intr);
+
+    std::atomic<bool> done(false);
+
+    std::thread watcher([&] {
+        while (!done) {
+            struct pollfd pfd = { fd, POLLRDHUP, 0 };
+            if (poll(&pfd, 1, 1000) > 0
+                && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+                vlc_interrupt_raise(intr);
+                break;
+            }
+        }
+    });
+
+    std::shared_ptr<Download> dl;
+
+    // Files this client has open
+    std::multiset<int> files;
+    bool paused = false;
+
+    for (DaemonRequest req; daemon_recv_request(fd, req);) {
+        DaemonReply rep = {};
+
+        try {
+            rep = handle(dl, files, paused, req, (char*) shm, opts);
+        } catch (std::runtime_error& e) {
+            rep.failed = true;
+            rep.text = e.what();
+        }
+
+        if (!daemon_send_reply(
+                fd, rep, req.type == DAEMON_HELLO ? shmfd : -1))
+            break;
+    }
+
+    done = true;
+    watcher.join();
+
+    vlc_interrupt_set(nullptr);
+    vlc_interrupt_destroy(intr);
+
+    // Client went away without closing
+    if (paused)
+        dl->resume();
+
+    for (int file : files)
+        dl->close_file(file);
+
+    munmap(shm, DAEMON_SHM_SIZE);
+    close(shmfd);
+    close(fd);
+}
+
+static bool
+parse_megabytes(const char* s, int64_t* bytes)
+{
+    char* end;
+    errno = 0;
+    long long mb = strtoll(s, &end, 10);
+    if (errno || end == s || *end || mb < 0 || mb > INT64_MAX / 1024 / 1024)
+        return false;
+
+    *bytes = (int64_t) mb * 1024 * 1024;
+    return true;
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::string socket_path = daemon_default_socket();
+    std::string profile = "low-latency";
+    std::string storage_mode = "sparse";
+    int64_t memory_limit = 0;
+    std::string metrics;
+    std::string timeline;
+
+    DaemonOptions opts;
+    opts.save_path = ".";
+    opts.keep = false;
+    opts.selective = true;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--save-path" && i + 1 < argc) {
+            opts.save_path = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile = argv[++i];
+        } else if (arg == "--memory-limit" && i + 1 < argc
+            && parse_megabytes(argv[i + 1], &memory_limit)) {
+            i++;
+        } else if (arg == "--storage-mode" && i + 1 < argc) {
+            storage_mode = argv[++i];
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            metrics = argv[++i];
+        } else if (arg == "--timeline" && i + 1 < argc) {
+            timeline = argv[++i];
+        } else if (arg == "--keep") {
+            opts.keep = true;
+        } else if (arg == "--all-files") {
+            opts.selective = false;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--socket PATH] [--save-path DIR] [--profile NAME]"
+                         " [--memory-limit MB]"
+                         " [--storage-mode sparse|allocate|region] [--keep]"
+                         " [--all-files] [--metrics FILE|unix:PATH]"
+                         " [--timeline FILE]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        Session::configure(Session::get_profile(profile), memory_limit);
+        Session::configure_metrics(metrics);
+        Timeline::configure(timeline);
+        opts.storage_mode = Download::get_storage_mode(storage_mode);
+    } catch (std::runtime_error& e) {
+        std::cerr << "Failed to configure: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Keep the session while idle, so there are always metrics to scrape
+    std::shared_ptr<Session> session;
+    if (!metrics.empty())
+        session = Session::get();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long" << std::endl;
+        return 1;
+    }
+
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create socket: " << strerror(errno)
+                  << std::endl;
+        return 1;
+    }
+
+    // Another daemon is already serving this socket
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+        std::cerr << "Already running on " << socket_path << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create socket: " << strerror(errno)
+                  << std::endl;
+        return 1;
+    }
+
+    // Left behind by a previous run
+    unlink(socket_path.c_str());
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+        || listen(fd, 16) < 0) {
+        std::cerr << "Failed to listen on " << socket_path << ": "
+                  << strerror(errno) << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    std::cout << "Listening on " << socket_path << std::endl;
+
+    for (;;) {
+        int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0 && errno == EINTR)
+            continue;
+        else if (client < 0) {
+            std::cerr << "Failed to accept: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        std::thread(serve, client, opts).detach();
+    }
+
+    close(fd);
+    unlink(socket_path.c_str());
+
+    return 1;
+}
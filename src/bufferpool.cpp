@@ -0,0 +1,140 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sstream>
+
+#include "bufferpool.h"
+
+#define D(x)
+
+#define kB (1024)
+#define MB (1024 * kB)
+
+// Smallest size class
+#define MIN_CLASS ((size_t) (16 * kB))
+
+// Idle buffers kept per size class, and in total
+#define MAX_IDLE_PER_CLASS 4
+#define MAX_IDLE_BYTES ((size_t) (32 * MB))
+
+static size_t
+size_class(size_t size)
+{
+    size_t c = MIN_CLASS;
+    while (c < size)
+        c <<= 1;
+    return c;
+}
+
+void
+PooledBufferDeleter::operator()(char* p) const
+{
+    BufferPool::get().release(p, size);
+}
+
+BufferPool::BufferPool()
+    : m_idle_bytes(0)
+    , m_allocated(0)
+    , m_reused(0)
+    , m_freed(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    for (auto& c : m_idle) {
+        for (char* p : c.second)
+            delete[] p;
+    }
+}
+
+PooledBuffer
+BufferPool::acquire(size_t size)
+{
+    size_t c = size_class(size);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        auto& idle = m_idle[c];
+        if (!idle.empty()) {
+            char* p = idle.back();
+            idle.pop_back();
+            m_idle_bytes -= c;
+
+            m_reused++;
+
+            return PooledBuffer(p, PooledBufferDeleter { c });
+        }
+    }
+
+    D(printf("%s:%d: %s(%lu): allocating %lu\n", __FILE__, __LINE__,
+        __func__, size, c));
+
+    m_allocated++;
+
+    return PooledBuffer(new char[c], PooledBufferDeleter { c });
+}
+
+void
+BufferPool::release(char* p, size_t size)
+{
+    if (!p)
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        auto& idle = m_idle[size];
+        if (idle.size() < MAX_IDLE_PER_CLASS
+            && m_idle_bytes + size <= MAX_IDLE_BYTES) {
+            idle.push_back(p);
+            m_idle_bytes += size;
+            return;
+        }
+    }
+
+    m_freed++;
+
+    delete[] p;
+}
+
+std::string
+BufferPool::get_stats()
+{
+    std::ostringstream os;
+
+    os << "buffers: " << m_allocated << " allocated, " << m_reused
+       << " reused, " << m_freed << " freed\n";
+
+    return os.str();
+}
+
+// static
+BufferPool&
+BufferPool::get()
+{
+    static BufferPool pool;
+
+    return pool;
+}
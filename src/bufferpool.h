@@ -0,0 +1,95 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_BUFFERPOOL_H
+#define VLC_BITTORRENT_BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct PooledBufferDeleter {
+    size_t size;
+
+    void
+    operator()(char* p) const;
+};
+
+/**
+ * Buffer that goes back to the pool when it's destroyed.
+ */
+using PooledBuffer = std::unique_ptr<char[], PooledBufferDeleter>;
+
+/**
+ * Process wide pool of large buffers, grouped in power-of-two size classes
+ * so that buffers can be reused for any size in the same class.
+ */
+class BufferPool {
+public:
+    BufferPool(const BufferPool&) = delete;
+    BufferPool&
+    operator=(const BufferPool&)
+        = delete;
+    BufferPool();
+    ~BufferPool();
+
+    /**
+     * Get a buffer of at least size bytes. Contents are undefined.
+     */
+    PooledBuffer
+    acquire(size_t size);
+
+    /**
+     * Allocation counters, one statistic per line.
+     */
+    std::string
+    get_stats();
+
+    static BufferPool&
+    get();
+
+private:
+    friend struct PooledBufferDeleter;
+
+    void
+    release(char* p, size_t size);
+
+    std::mutex m_mtx;
+
+    // Idle buffers by size class
+    std::map<size_t, std::vector<char*>> m_idle;
+
+    size_t m_idle_bytes;
+
+    // Heap allocations made
+    std::atomic<uint64_t> m_allocated;
+
+    // Requests served with an idle buffer
+    std::atomic<uint64_t> m_reused;
+
+    // Buffers freed because too much was idle
+    std::atomic<uint64_t> m_freed;
+};
+
+#endif
@@ -0,0 +1,377 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "container.h"
+
+#define D(x)
+
+#define kB (1024)
+#define MB (1024 * kB)
+
+// Never read headers beyond this offset. The demuxer will need this part of
+// the file right away anyway, so reading it doesn't cost anything extra.
+#define PROBE_LIMIT (256 * kB)
+
+// Upper bound of an index whose size can't be known without reading it
+#define INDEX_MAX (16 * MB)
+
+#define MKV_ID_EBML 0x1A45DFA3
+#define MKV_ID_SEGMENT 0x18538067
+#define MKV_ID_SEEKHEAD 0x114D9B74
+#define MKV_ID_SEEK 0x4DBB
+#define MKV_ID_SEEKID 0x53AB
+#define MKV_ID_SEEKPOSITION 0x53AC
+#define MKV_ID_CUES 0x1C53BB6B
+#define MKV_ID_CLUSTER 0x1F43B675
+
+using Ranges = std::vector<std::pair<int64_t, int64_t>>;
+
+static bool
+read_full(ContainerReader& reader, int64_t off, char* buf, size_t buflen)
+{
+    while (buflen > 0) {
+        ssize_t r = reader(off, buf, buflen);
+        if (r <= 0)
+            return false;
+
+        off += r;
+        buf += r;
+        buflen -= (size_t) r;
+    }
+
+    return true;
+}
+
+static uint64_t
+be(const char* buf, size_t len)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; i++)
+        v = (v << 8) | (uint8_t) buf[i];
+    return v;
+}
+
+static uint64_t
+le(const char* buf, size_t len)
+{
+    uint64_t v = 0;
+    for (size_t i = len; i > 0; i--)
+        v = (v << 8) | (uint8_t) buf[i - 1];
+    return v;
+}
+
+static void
+add_range(Ranges& ranges, int64_t off, int64_t len, int64_t filesz)
+{
+    if (off < 0 || off >= filesz)
+        return;
+
+    len = std::min(len, filesz - off);
+    if (len > 0)
+        ranges.push_back(std::make_pair(off, len));
+}
+
+static bool
+is_mp4(const char* hdr)
+{
+    static const char* types[]
+        = { "ftyp", "moov", "mdat", "free", "skip", "wide", "pdin", "styp" };
+
+    for (auto* t : types) {
+        if (memcmp(hdr + 4, t, 4) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static Ranges
+probe_mp4(ContainerReader& reader, int64_t filesz)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    Ranges ranges;
+
+    int64_t off = 0;
+    while (off < PROBE_LIMIT && off + 8 <= filesz) {
+        char hdr[16];
+        if (!read_full(reader, off, hdr, 8))
+            break;
+
+        int64_t hdrsz = 8;
+        int64_t boxsz = (int64_t) be(hdr, 4);
+        if (boxsz == 1) {
+            // 64-bit box size follows the type
+            if (!read_full(reader, off + 8, hdr + 8, 8))
+                break;
+            boxsz = (int64_t) be(hdr + 8, 8);
+            hdrsz = 16;
+        } else if (boxsz == 0) {
+            // Box extends to end of file
+            boxsz = filesz - off;
+        }
+
+        if (boxsz < hdrsz)
+            break;
+
+        if (memcmp(hdr + 4, "moov", 4) == 0) {
+            add_range(ranges, off, boxsz, filesz);
+            return ranges;
+        }
+
+        if (memcmp(hdr + 4, "mdat", 4) == 0 && off + boxsz >= PROBE_LIMIT) {
+            // The media data comes first and moov is somewhere after it.
+            // Whatever follows mdat is small compared to it, so take it all.
+            add_range(ranges, off + boxsz, INDEX_MAX, filesz);
+            return ranges;
+        }
+
+        off += boxsz;
+    }
+
+    return ranges;
+}
+
+// Read a Matroska element ID. Leading length marker bits are kept.
+static bool
+mkv_id(const char* buf, size_t buflen, size_t& pos, uint32_t& id)
+{
+    if (pos >= buflen)
+        return false;
+
+    uint8_t first = (uint8_t) buf[pos];
+
+    size_t len = 1;
+    while (len <= 4 && !(first & (0x80 >> (len - 1))))
+        len++;
+    if (len > 4 || pos + len > buflen)
+        return false;
+
+    id = (uint32_t) be(buf + pos, len);
+    pos += len;
+
+    return true;
+}
+
+// Read a Matroska element data size. Unknown sizes are returned as -1.
+static bool
+mkv_size(const char* buf, size_t buflen, size_t& pos, int64_t& size)
+{
+    if (pos >= buflen)
+        return false;
+
+    uint8_t first = (uint8_t) buf[pos];
+
+    size_t len = 1;
+    while (len <= 8 && !(first & (0x80 >> (len - 1))))
+        len++;
+    if (len > 8 || pos + len > buflen)
+        return false;
+
+    uint64_t mask = (len == 8) ? 0 : (0xFFu >> len);
+    uint64_t v = first & mask;
+    bool unknown = (v == mask);
+    for (size_t i = 1; i < len; i++) {
+        v = (v << 8) | (uint8_t) buf[pos + i];
+        unknown = unknown && ((uint8_t) buf[pos + i] == 0xFF);
+    }
+    pos += len;
+
+    size = unknown ? -1 : (int64_t) v;
+
+    return true;
+}
+
+static Ranges
+probe_mkv(ContainerReader& reader, int64_t filesz)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    Ranges ranges;
+
+    std::vector<char> buf((size_t) std::min((int64_t) PROBE_LIMIT, filesz));
+    if (!read_full(reader, 0, buf.data(), buf.size()))
+        return ranges;
+
+    size_t pos = 0;
+    uint32_t id;
+    int64_t size;
+
+    // EBML header
+    if (!mkv_id(buf.data(), buf.size(), pos, id) || id != MKV_ID_EBML)
+        return ranges;
+    if (!mkv_size(buf.data(), buf.size(), pos, size) || size < 0)
+        return ranges;
+    pos += (size_t) size;
+
+    // Segment, which everything else is relative to
+    if (!mkv_id(buf.data(), buf.size(), pos, id) || id != MKV_ID_SEGMENT)
+        return ranges;
+    if (!mkv_size(buf.data(), buf.size(), pos, size))
+        return ranges;
+
+    int64_t segment = (int64_t) pos;
+
+    std::vector<int64_t> positions;
+    int64_t cues = -1;
+
+    // Walk top-level elements of the segment until the first cluster
+    while (pos < buf.size()) {
+        int64_t elem = (int64_t) pos;
+
+        if (!mkv_id(buf.data(), buf.size(), pos, id))
+            break;
+        if (!mkv_size(buf.data(), buf.size(), pos, size))
+            break;
+
+        if (id == MKV_ID_CUES && size >= 0) {
+            // Cues placed before the clusters
+            add_range(ranges, elem, (int64_t) pos - elem + size, filesz);
+            return ranges;
+        }
+
+        if (id == MKV_ID_CLUSTER || size < 0)
+            break;
+
+        if (id == MKV_ID_SEEKHEAD) {
+            size_t end = std::min(buf.size(), pos + (size_t) size);
+
+            while (pos < end) {
+                if (!mkv_id(buf.data(), end, pos, id))
+                    break;
+                if (!mkv_size(buf.data(), end, pos, size) || size < 0)
+                    break;
+
+                if (id != MKV_ID_SEEK) {
+                    pos += (size_t) size;
+                    continue;
+                }
+
+                size_t seekend = std::min(end, pos + (size_t) size);
+                uint32_t seekid = 0;
+                int64_t seekpos = -1;
+
+                while (pos < seekend) {
+                    uint32_t cid;
+                    int64_t csize;
+                    if (!mkv_id(buf.data(), seekend, pos, cid))
+                        break;
+                    if (!mkv_size(buf.data(), seekend, pos, csize)
+                        || csize < 0 || pos + (size_t) csize > seekend
+                        || csize > 8)
+                        break;
+
+                    if (cid == MKV_ID_SEEKID)
+                        seekid = (uint32_t) be(buf.data() + pos, (size_t) csize);
+                    else if (cid == MKV_ID_SEEKPOSITION)
+                        seekpos = (int64_t) be(buf.data() + pos, (size_t) csize);
+
+                    pos += (size_t) csize;
+                }
+                pos = seekend;
+
+                if (seekpos < 0)
+                    continue;
+
+                positions.push_back(segment + seekpos);
+                if (seekid == MKV_ID_CUES)
+                    cues = segment + seekpos;
+            }
+
+            pos = end;
+            continue;
+        }
+
+        pos += (size_t) size;
+    }
+
+    if (cues < 0)
+        return ranges;
+
+    // Cues end where the next element pointed to by the seek head begins
+    int64_t end = std::min(filesz, cues + INDEX_MAX);
+    for (auto p : positions) {
+        if (p > cues)
+            end = std::min(end, p);
+    }
+
+    add_range(ranges, cues, end - cues, filesz);
+
+    return ranges;
+}
+
+static Ranges
+probe_avi(ContainerReader& reader, int64_t filesz)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    Ranges ranges;
+
+    char hdr[12];
+    if (!read_full(reader, 0, hdr, 12))
+        return ranges;
+
+    int64_t riffend = std::min(filesz, 8 + (int64_t) le(hdr + 4, 4));
+
+    // Walk chunks of the RIFF AVI list until the movi list
+    int64_t off = 12;
+    while (off < PROBE_LIMIT && off + 12 <= riffend) {
+        if (!read_full(reader, off, hdr, 12))
+            break;
+
+        int64_t chunksz = 8 + (int64_t) le(hdr + 4, 4);
+        chunksz += chunksz & 1;
+
+        if (memcmp(hdr, "LIST", 4) == 0 && memcmp(hdr + 8, "movi", 4) == 0) {
+            // The idx1 chunk follows right after the movi list
+            add_range(ranges, off + chunksz, riffend - off - chunksz, filesz);
+            return ranges;
+        }
+
+        off += chunksz;
+    }
+
+    return ranges;
+}
+
+std::vector<std::pair<int64_t, int64_t>>
+probe_index(ContainerReader reader, int64_t filesz)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    char hdr[12];
+    if (filesz < 12 || !read_full(reader, 0, hdr, 12))
+        return Ranges();
+
+    if (be(hdr, 4) == MKV_ID_EBML)
+        return probe_mkv(reader, filesz);
+    else if (memcmp(hdr, "RIFF", 4) == 0 && memcmp(hdr + 8, "AVI ", 4) == 0)
+        return probe_avi(reader, filesz);
+    else if (is_mp4(hdr))
+        return probe_mp4(reader, filesz);
+
+    return Ranges();
+}
@@ -0,0 +1,42 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_CONTAINER_H
+#define VLC_BITTORRENT_CONTAINER_H
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+// Reads up to buflen bytes at offset off. Returns number of bytes read.
+using ContainerReader = std::function<ssize_t(int64_t, char*, size_t)>;
+
+/**
+ * Find where the seek index of a media file is located by parsing the box,
+ * element or chunk headers near the start of the file. Understands MP4/MOV
+ * (moov), Matroska/WebM (Cues) and AVI (idx1). Only the first few hundred
+ * kB of the file is read. Returns a list of (offset, length) ranges.
+ */
+std::vector<std::pair<int64_t, int64_t>>
+probe_index(ContainerReader reader, int64_t filesz);
+
+#endif
@@ -0,0 +1,541 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "daemon.h"
+
+#define D(x)
+
+// Largest text accepted in a message, torrent metadata being the biggest
+#define MAX_TEXT_SIZE (16 * 1024 * 1024)
+
+struct DaemonWireRequest {
+    uint32_t type;
+    uint32_t textlen;
+    int64_t file;
+    int64_t off;
+    int64_t len;
+    int64_t window;
+    int64_t limit;
+};
+
+struct DaemonWireReply {
+    uint32_t failed;
+    uint32_t textlen;
+    int64_t value;
+    int64_t extra;
+};
+
+#ifdef __linux__
+
+static bool
+send_all(int fd, const void* buf, size_t len, int passfd)
+{
+    const char* p = (const char*) buf;
+
+    while (len > 0) {
+        struct iovec iov;
+        iov.iov_base = (void*) p;
+        iov.iov_len = len;
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        char cbuf[CMSG_SPACE(sizeof(int))];
+        if (passfd >= 0) {
+            memset(cbuf, 0, sizeof(cbuf));
+            msg.msg_control = cbuf;
+            msg.msg_controllen = sizeof(cbuf);
+
+            struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+            c->cmsg_level = SOL_SOCKET;
+            c->cmsg_type = SCM_RIGHTS;
+            c->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(c), &passfd, sizeof(int));
+        }
+
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        else if (n <= 0)
+            return false;
+
+        // The descriptor goes along with the first byte only
+        passfd = -1;
+
+        p += n;
+        len -= (size_t) n;
+    }
+
+    return true;
+}
+
+static bool
+recv_all(int fd, void* buf, size_t len, int* passfd,
+    const DaemonInterruptCb& interrupted)
+{
+    char* p = (char*) buf;
+
+    while (len > 0) {
+        if (interrupted) {
+            // Wake up now and then to see if the reader gave up
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            int r = poll(&pfd, 1, 100);
+            if (r < 0 && errno != EINTR)
+                return false;
+            else if (r <= 0) {
+                if (interrupted())
+                    return false;
+                continue;
+            }
+        }
+
+        struct iovec iov;
+        iov.iov_base = p;
+        iov.iov_len = len;
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        char cbuf[CMSG_SPACE(sizeof(int))];
+        if (passfd) {
+            msg.msg_control = cbuf;
+            msg.msg_controllen = sizeof(cbuf);
+        }
+
+        ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR)
+            continue;
+        else if (n <= 0)
+            return false;
+
+        if (passfd) {
+            for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c;
+                 c = CMSG_NXTHDR(&msg, c)) {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+                    memcpy(passfd, CMSG_DATA(c), sizeof(int));
+            }
+        }
+
+        p += n;
+        len -= (size_t) n;
+    }
+
+    return true;
+}
+
+static bool
+recv_text(int fd, uint32_t len, std::string& text,
+    const DaemonInterruptCb& interrupted)
+{
+    if (len > MAX_TEXT_SIZE)
+        return false;
+
+    text.resize(len);
+    if (len == 0)
+        return true;
+
+    return recv_all(fd, &text[0], len, nullptr, interrupted);
+}
+
+bool
+daemon_send_request(int fd, const DaemonRequest& req)
+{
+    DaemonWireRequest w;
+    w.type = req.type;
+    w.textlen = (uint32_t) req.text.size();
+    w.file = req.file;
+    w.off = req.off;
+    w.len = req.len;
+    w.window = req.window;
+    w.limit = req.limit;
+
+    return send_all(fd, &w, sizeof(w), -1)
+        && send_all(fd, req.text.data(), req.text.size(), -1);
+}
+
+bool
+daemon_recv_request(int fd, DaemonRequest& req)
+{
+    DaemonWireRequest w;
+    if (!recv_all(fd, &w, sizeof(w), nullptr, nullptr))
+        return false;
+
+    req.type = w.type;
+    req.file = w.file;
+    req.off = w.off;
+    req.len = w.len;
+    req.window = w.window;
+    req.limit = w.limit;
+
+    return recv_text(fd, w.textlen, req.text, nullptr);
+}
+
+bool
+daemon_send_reply(int fd, const DaemonReply& rep, int passfd)
+{
+    DaemonWireReply w;
+    w.failed = rep.failed ? 1 : 0;
+    w.textlen = (uint32_t) rep.text.size();
+    w.value = rep.value;
+    w.extra = rep.extra;
+
+    return send_all(fd, &w, sizeof(w), passfd)
+        && send_all(fd, rep.text.data(), rep.text.size(), -1);
+}
+
+bool
+daemon_recv_reply(
+    int fd, DaemonReply& rep, int* passfd, DaemonInterruptCb interrupted)
+{
+    DaemonWireReply w;
+    if (!recv_all(fd, &w, sizeof(w), passfd, interrupted))
+        return false;
+
+    rep.failed = w.failed != 0;
+    rep.value = w.value;
+    rep.extra = w.extra;
+
+    return recv_text(fd, w.textlen, rep.text, interrupted);
+}
+
+std::string
+daemon_default_socket()
+{
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    if (dir && *dir)
+        return std::string(dir) + "/vlc-bittorrentd.sock";
+
+    return "/tmp/vlc-bittorrentd-" + std::to_string(getuid()) + ".sock";
+}
+
+#else
+
+bool
+daemon_send_request(int fd, const DaemonRequest& req)
+{
+    return false;
+}
+
+bool
+daemon_recv_request(int fd, DaemonRequest& req)
+{
+    return false;
+}
+
+bool
+daemon_send_reply(int fd, const DaemonReply& rep, int passfd)
+{
+    return false;
+}
+
+bool
+daemon_recv_reply(
+    int fd, DaemonReply& rep, int* passfd, DaemonInterruptCb interrupted)
+{
+    return false;
+}
+
+std::string
+daemon_default_socket()
+{
+    return std::string();
+}
+
+#endif
+
+RemoteDownload::RemoteDownload(std::string socket_path, char* metadata,
+    size_t metadatalen, DaemonInterruptCb interrupted)
+    : m_interrupted(interrupted)
+    , m_fd(-1)
+    , m_shm(nullptr)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__,
+        socket_path.c_str()));
+
+#ifdef __linux__
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Daemon socket path too long");
+
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+        throw std::runtime_error("Failed to create socket");
+
+    if (connect(m_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        close(m_fd);
+        throw std::runtime_error("Failed to connect to daemon");
+    }
+
+    try {
+        DaemonRequest req = {};
+        req.type = DAEMON_HELLO;
+
+        int shmfd = -1;
+        call(req, &shmfd);
+        if (shmfd < 0)
+            throw std::runtime_error("No shared memory from daemon");
+
+        void* shm
+            = mmap(nullptr, DAEMON_SHM_SIZE, PROT_READ, MAP_SHARED, shmfd, 0);
+        close(shmfd);
+        if (shm == MAP_FAILED)
+            throw std::runtime_error("Failed to map shared memory");
+
+        m_shm = (char*) shm;
+
+        req.type = DAEMON_OPEN;
+        req.text.assign(metadata, metadatalen);
+        call(req, nullptr);
+    } catch (std::runtime_error&) {
+        if (m_shm)
+            munmap(m_shm, DAEMON_SHM_SIZE);
+        if (m_fd >= 0)
+            close(m_fd);
+        throw;
+    }
+#else
+    throw std::runtime_error("Daemon mode is only supported on Linux");
+#endif
+}
+
+RemoteDownload::~RemoteDownload()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+#ifdef __linux__
+    if (m_shm)
+        munmap(m_shm, DAEMON_SHM_SIZE);
+    if (m_fd >= 0)
+        close(m_fd);
+#endif
+}
+
+// Called with m_mtx held, except from the constructor
+DaemonReply
+RemoteDownload::call(const DaemonRequest& req, int* passfd)
+{
+    if (m_fd < 0)
+        throw std::runtime_error("Not connected to daemon");
+
+    DaemonReply rep;
+    if (!daemon_send_request(m_fd, req)
+        || !daemon_recv_reply(m_fd, rep, passfd, m_interrupted)) {
+#ifdef __linux__
+        // Interrupted or lost, either way the stream is out of sync
+        close(m_fd);
+#endif
+        m_fd = -1;
+        throw std::runtime_error("Daemon request failed");
+    }
+
+    if (rep.failed)
+        throw std::runtime_error(rep.text);
+
+    return rep;
+}
+
+ssize_t
+RemoteDownload::read(int file, int64_t off, char* buf, size_t buflen,
+    int64_t window, std::function<void(float)> progress_cb)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_READ;
+    req.file = file;
+    req.off = off;
+    req.len = (int64_t) std::min(buflen, (size_t) DAEMON_SHM_SIZE);
+    req.window = window;
+
+    DaemonReply rep = call(req, nullptr);
+    if (rep.value > req.len)
+        throw std::runtime_error("Daemon read reply too long");
+    if (rep.value > 0)
+        memcpy(buf, m_shm, (size_t) rep.value);
+
+    return (ssize_t) rep.value;
+}
+
+void
+RemoteDownload::pause(int file, int64_t off, int64_t window, int upload_limit)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_PAUSE;
+    req.file = file;
+    req.off = off;
+    req.window = window;
+    req.limit = upload_limit;
+
+    call(req, nullptr);
+}
+
+void
+RemoteDownload::resume()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_RESUME;
+
+    call(req, nullptr);
+}
+
+void
+RemoteDownload::open_file(int file)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_OPEN_FILE;
+    req.file = file;
+
+    call(req, nullptr);
+}
+
+void
+RemoteDownload::close_file(int file)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_CLOSE_FILE;
+    req.file = file;
+
+    call(req, nullptr);
+}
+
+std::string
+RemoteDownload::get_stats()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_STATS;
+
+    return call(req, nullptr).text;
+}
+
+int64_t
+RemoteDownload::get_download_rate()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_RATE;
+
+    return call(req, nullptr).value;
+}
+
+int
+RemoteDownload::get_num_peers()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_PEERS;
+
+    return (int) call(req, nullptr).value;
+}
+
+bool
+RemoteDownload::is_local(int file, int64_t off, int64_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_IS_LOCAL;
+    req.file = file;
+    req.off = off;
+    req.len = size;
+
+    return call(req, nullptr).value != 0;
+}
+
+void
+RemoteDownload::prefetch(int file, int64_t off, int64_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_PREFETCH;
+    req.file = file;
+    req.off = off;
+    req.len = size;
+
+    call(req, nullptr);
+}
+
+int
+RemoteDownload::prefetch_sidecars(int file)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_SIDECARS;
+    req.file = file;
+
+    return (int) call(req, nullptr).value;
+}
+
+std::pair<int, uint64_t>
+RemoteDownload::get_file(std::string path)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    DaemonRequest req = {};
+    req.type = DAEMON_GET_FILE;
+    req.text = path;
+
+    DaemonReply rep = call(req, nullptr);
+
+    return { (int) rep.value, (uint64_t) rep.extra };
+}
@@ -0,0 +1,190 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_DAEMON_H
+#define VLC_BITTORRENT_DAEMON_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <sys/types.h>
+
+// Size of the shared memory area each client reads through
+#define DAEMON_SHM_SIZE (4 * 1024 * 1024)
+
+enum DaemonRequestType : uint32_t {
+    // Reply carries the shared memory file descriptor
+    DAEMON_HELLO = 1,
+    // text is the torrent metadata
+    DAEMON_OPEN,
+    // text is the path, reply value is the index and extra the size
+    DAEMON_GET_FILE,
+    // Reply value is the number of bytes put in shared memory
+    DAEMON_READ,
+    DAEMON_PREFETCH,
+    DAEMON_PAUSE,
+    DAEMON_RESUME,
+    // Reply text is the statistics
+    DAEMON_STATS,
+    // Reply value is the download rate
+    DAEMON_RATE,
+    DAEMON_OPEN_FILE,
+    DAEMON_CLOSE_FILE,
+    // Reply value is the number of peers
+    DAEMON_PEERS,
+    // Reply value is one if the range is downloaded
+    DAEMON_IS_LOCAL,
+    // Reply value is the number of files prefetched
+    DAEMON_SIDECARS,
+};
+
+/**
+ * A request from a plugin instance. Which of the fields are used depends on
+ * the type.
+ */
+struct DaemonRequest {
+    uint32_t type;
+    int64_t file;
+    int64_t off;
+    int64_t len;
+    int64_t window;
+    int64_t limit;
+    std::string text;
+};
+
+/**
+ * A reply from the daemon. If failed is set, text is the error message.
+ */
+struct DaemonReply {
+    bool failed;
+    int64_t value;
+    int64_t extra;
+    std::string text;
+};
+
+using DaemonInterruptCb = std::function<bool()>;
+
+bool
+daemon_send_request(int fd, const DaemonRequest& req);
+
+bool
+daemon_recv_request(int fd, DaemonRequest& req);
+
+/**
+ * Send a reply, passing a file descriptor along with it unless passfd is
+ * negative.
+ */
+bool
+daemon_send_reply(int fd, const DaemonReply& rep, int passfd);
+
+/**
+ * Receive a reply. Gives up if interrupted returns true while waiting.
+ */
+bool
+daemon_recv_reply(
+    int fd, DaemonReply& rep, int* passfd, DaemonInterruptCb interrupted);
+
+/**
+ * Socket path used by the daemon when none is given.
+ */
+std::string
+daemon_default_socket();
+
+/**
+ * A download owned by a vlc-bittorrentd process on the same host. Data is
+ * passed through a shared memory area instead of the socket. Each instance
+ * has its own connection, so requests from one stream don't wait on
+ * another.
+ */
+class RemoteDownload {
+
+public:
+    RemoteDownload(const RemoteDownload&) = delete;
+    RemoteDownload&
+    operator=(const RemoteDownload&)
+        = delete;
+
+    /**
+     * Connect to the daemon and add the download there. Throws if the daemon
+     * isn't running or didn't accept the metadata.
+     */
+    RemoteDownload(std::string socket_path, char* metadata,
+        size_t metadatalen, DaemonInterruptCb interrupted);
+    ~RemoteDownload();
+
+    ssize_t
+    read(int file, int64_t off, char* buf, size_t buflen, int64_t window,
+        std::function<void(float)> progress_cb);
+
+    ssize_t
+    read(int file, int64_t off, char* buf, size_t buflen)
+    {
+        return read(file, off, buf, buflen, 0, nullptr);
+    }
+
+    void
+    pause(int file, int64_t off, int64_t window, int upload_limit);
+
+    void
+    resume();
+
+    void
+    open_file(int file);
+
+    void
+    close_file(int file);
+
+    std::string
+    get_stats();
+
+    int64_t
+    get_download_rate();
+
+    int
+    get_num_peers();
+
+    bool
+    is_local(int file, int64_t off, int64_t size);
+
+    void
+    prefetch(int file, int64_t off, int64_t size);
+
+    int
+    prefetch_sidecars(int file);
+
+    std::pair<int, uint64_t>
+    get_file(std::string path);
+
+private:
+    DaemonReply
+    call(const DaemonRequest& req, int* passfd);
+
+    std::mutex m_mtx;
+
+    DaemonInterruptCb m_interrupted;
+
+    int m_fd;
+
+    char* m_shm;
+};
+
+#endif
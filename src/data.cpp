@@ -21,45 +21,250 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #include "config.h"
 #endif
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
+#include "bufferpool.h"
+#include "container.h"
+#include "daemon.h"
 #include "download.h"
 #include "data.h"
+#include "readahead.h"
+#include "trace.h"
 #include "vlc.h"
 
-#define MIN_CACHING_TIME (10000)
-
 #define D(x)
 
+// Read started in the background for the chunk after the last one read.
+// Shared with the completion, which may run after the stream is closed.
+struct data_prefetch {
+    std::mutex mtx;
+
+    std::condition_variable cv;
+
+    bool b_done;
+
+    ssize_t i_len;
+
+    std::exception_ptr error;
+
+    PooledBuffer buf;
+
+    // Position of buf within the file
+    uint64_t i_off;
+
+    // Bytes of buf already handed out
+    size_t i_used;
+
+    // For cancelling, as other streams may be reading the same download
+    uint64_t i_id;
+};
+
 struct data_sys {
     std::shared_ptr<Download> p_download;
 
+    std::shared_ptr<data_prefetch> p_prefetch;
+
+    // Set instead of p_download when attached to vlc-bittorrentd
+    std::unique_ptr<RemoteDownload> p_remote;
+
     // Current open file
     int i_file;
 
     // Current position within the current open file
     uint64_t i_pos;
+
+    // Consumption and download rate tracking
+    ReadAhead readahead;
+
+    // Access pattern recording, if enabled
+    std::shared_ptr<TraceWriter> p_trace;
+
+    uint16_t i_stream;
+
+    // Paused by the player, each pause() being matched by a resume()
+    bool b_paused;
+
+    // Looks for the seek index while the stream plays
+    std::thread probe_thread;
+
+    // Makes the probe give up
+    std::atomic<bool> b_closing;
 };
 
+// Call f with whichever download is in use
+template <typename F>
+static auto
+with_download(data_sys* p_sys, F f)
+{
+    if (p_sys->p_remote)
+        return f(*p_sys->p_remote);
+    else
+        return f(*p_sys->p_download);
+}
+
+// Completion that fills in pf and wakes up whoever waits for it
+static ReadCompletion
+complete(std::shared_ptr<data_prefetch> pf)
+{
+    return [pf](ssize_t len, std::exception_ptr error) {
+        std::unique_lock<std::mutex> lock(pf->mtx);
+
+        pf->i_len = len;
+        pf->error = error;
+        pf->b_done = true;
+        pf->cv.notify_all();
+    };
+}
+
+// Start reading the chunk at the current position in the background, so it
+// downloads while the demuxer is busy with the previous one
+static void
+start_prefetch(data_sys* p_sys, size_t i_size)
+{
+    auto pf = std::make_shared<data_prefetch>();
+    pf->b_done = false;
+    pf->i_len = 0;
+    pf->buf = BufferPool::get().acquire(i_size);
+    pf->i_off = p_sys->i_pos;
+    pf->i_used = 0;
+
+    p_sys->p_prefetch = pf;
+
+    pf->i_id = p_sys->p_download->async_read(p_sys->i_file, (int64_t) pf->i_off,
+        pf->buf.get(), i_size, p_sys->readahead.window(), complete(pf));
+}
+
+// Serve from the background read if it's for the current position. Returns
+// false if the caller has to read by itself.
+static bool
+use_prefetch(data_sys* p_sys, void* p_data, size_t i_size, ssize_t& size)
+{
+    std::shared_ptr<data_prefetch> pf = p_sys->p_prefetch;
+    if (!pf)
+        return false;
+
+    if (pf->i_off + pf->i_used != p_sys->i_pos) {
+        // Seeked away, so it isn't needed anymore
+        p_sys->p_prefetch.reset();
+        p_sys->p_download->cancel_read(pf->i_id);
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(pf->mtx);
+
+    while (!pf->b_done) {
+        pf->cv.wait_for(lock, std::chrono::milliseconds(100));
+
+        if (vlc_killed())
+            throw std::runtime_error("Interrupted");
+    }
+
+    // Let a plain read deal with errors and end of file
+    if (pf->error || pf->i_len <= 0) {
+        p_sys->p_prefetch.reset();
+        return false;
+    }
+
+    size_t n = std::min(i_size, (size_t) pf->i_len - pf->i_used);
+
+    memcpy(p_data, pf->buf.get() + pf->i_used, n);
+
+    pf->i_used += n;
+    if (pf->i_used >= (size_t) pf->i_len)
+        p_sys->p_prefetch.reset();
+
+    size = (ssize_t) n;
+
+    return true;
+}
+
+// Read that gives up when the stream is closed, for the index probe
 static ssize_t
-DataRead(stream_extractor_t* p_extractor, void* p_data, size_t i_size)
+read_unless_closed(Download& dl, std::atomic<bool>& closing, int file,
+    int64_t off, char* buf, size_t buflen)
 {
-    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+    auto pf = std::make_shared<data_prefetch>();
+    pf->b_done = false;
+    pf->i_len = 0;
 
-    data_sys* p_sys = (data_sys*) p_extractor->p_sys;
-    if (!p_sys)
-        return -1;
-    else if (!p_sys->p_download)
-        return -1;
+    uint64_t id = dl.async_read(file, off, buf, buflen, 0, complete(pf));
+
+    std::unique_lock<std::mutex> lock(pf->mtx);
+
+    while (!pf->b_done) {
+        if (closing) {
+            lock.unlock();
+            dl.cancel_read(id);
+            lock.lock();
+
+            // The completion may be copying into buf right now
+            pf->cv.wait(lock, [&pf] { return pf->b_done; });
+
+            throw std::runtime_error("Stream closed");
+        }
 
+        pf->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+
+    if (pf->error)
+        std::rethrow_exception(pf->error);
+
+    return pf->i_len;
+}
+
+// Find the seek index of the container and fetch it before the demuxer asks
+// for it
+template <typename D>
+static void
+fetch_index(stream_extractor_t* p_extractor, D& dl, int file, int64_t filesz,
+    ContainerReader reader)
+{
     try {
-        ssize_t size = p_sys->p_download->read((int) p_sys->i_file,
-            (int64_t) p_sys->i_pos, (char*) p_data, i_size);
-        if (size > 0)
+        auto ranges = probe_index(reader, filesz);
+        for (auto& r : ranges) {
+            msg_Dbg(p_extractor, "Found index at %" PRId64 " (%" PRId64
+                " bytes)", r.first, r.second);
+
+            dl.prefetch(file, r.first, r.second);
+        }
+    } catch (std::runtime_error& e) {
+        msg_Dbg(p_extractor, "Failed to probe index: %s", e.what());
+    }
+}
+
+static ssize_t
+ReadData(stream_extractor_t* p_extractor, data_sys* p_sys, void* p_data,
+    size_t i_size)
+{
+    try {
+        if (p_sys->readahead.due())
+            p_sys->readahead.downloading(with_download(
+                p_sys, [](auto& dl) { return dl.get_download_rate(); }));
+
+        ssize_t size;
+        if (!p_sys->p_download || !use_prefetch(p_sys, p_data, i_size, size))
+            size = with_download(p_sys, [&](auto& dl) {
+                return dl.read((int) p_sys->i_file, (int64_t) p_sys->i_pos,
+                    (char*) p_data, i_size, p_sys->readahead.window(),
+                    nullptr);
+            });
+        if (size > 0) {
             p_sys->i_pos += (uint64_t) size;
-        else if (size < 0)
+            p_sys->readahead.consumed((size_t) size);
+        } else if (size < 0)
             return 0;
 
+        if (size > 0 && p_sys->p_download && !p_sys->p_prefetch)
+            start_prefetch(p_sys, i_size);
+
         return size;
     } catch (std::runtime_error& e) {
         msg_Dbg(p_extractor, "Read failed: %s", e.what());
@@ -68,6 +273,46 @@ DataRead(stream_extractor_t* p_extractor, void* p_data, size_t i_size)
     return -1;
 }
 
+static ssize_t
+DataRead(stream_extractor_t* p_extractor, void* p_data, size_t i_size)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    data_sys* p_sys = (data_sys*) p_extractor->p_sys;
+    if (!p_sys)
+        return -1;
+    else if (!p_sys->p_download && !p_sys->p_remote)
+        return -1;
+
+    if (!p_sys->p_trace)
+        return ReadData(p_extractor, p_sys, p_data, i_size);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t i_pos = p_sys->i_pos;
+
+    uint8_t flags = 0;
+    try {
+        if (with_download(p_sys, [&](auto& dl) {
+                return dl.is_local(p_sys->i_file, (int64_t) i_pos,
+                    (int64_t) i_size);
+            }))
+            flags |= TraceRecord::FLAG_HIT;
+    } catch (std::runtime_error& e) {
+    }
+
+    ssize_t size = ReadData(p_extractor, p_sys, p_data, i_size);
+    if (size <= 0)
+        flags |= TraceRecord::FLAG_FAILED;
+
+    p_sys->p_trace->add(p_sys->i_stream, p_sys->i_file, (int64_t) i_pos,
+        i_size,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start),
+        flags);
+
+    return size;
+}
+
 static int
 DataSeek(stream_extractor_t* p_extractor, uint64_t i_pos)
 {
@@ -82,6 +327,10 @@ DataSeek(stream_extractor_t* p_extractor, uint64_t i_pos)
 
     p_sys->i_pos = i_pos;
 
+    if (p_sys->p_trace)
+        p_sys->p_trace->add(p_sys->i_stream, p_sys->i_file, (int64_t) i_pos,
+            0, std::chrono::microseconds(0), TraceRecord::FLAG_SEEK);
+
     return VLC_SUCCESS;
 }
 
@@ -96,7 +345,7 @@ DataControl(stream_extractor_t* p_extractor, int i_query, va_list args)
     data_sys* p_sys = (data_sys*) p_extractor->p_sys;
     if (!p_sys)
         return VLC_EGENERIC;
-    else if (!p_sys->p_download)
+    else if (!p_sys->p_download && !p_sys->p_remote)
         return VLC_EGENERIC;
 
     switch (i_query) {
@@ -112,16 +361,66 @@ DataControl(stream_extractor_t* p_extractor, int i_query, va_list args)
     case STREAM_CAN_CONTROL_PACE:
         *va_arg(args, bool*) = true;
         break;
-    case STREAM_GET_PTS_DELAY:
+    case STREAM_GET_PTS_DELAY: {
+        // Buffer as if it were a file when the data is already here, more
+        // the less the swarm keeps up with playback
+        int64_t caching = -1;
+        bool local = false;
+
+        try {
+            with_download(p_sys, [&](auto& dl) {
+                p_sys->readahead.downloading(dl.get_download_rate());
+
+                local = dl.is_local(p_sys->i_file, (int64_t) p_sys->i_pos,
+                    p_sys->readahead.window());
+                caching = p_sys->readahead.caching(local, dl.get_num_peers());
+            });
+        } catch (std::runtime_error& e) {
+            msg_Dbg(p_extractor, "Swarm health unknown: %s", e.what());
+        }
+
+        if (caching < 0)
+            caching = p_sys->readahead.caching(false, 0);
+
+        msg_Dbg(p_extractor, "Caching %" PRId64 " ms", caching);
+
         *va_arg(args, int64_t*) = INT64_C(1000)
-            * __MAX(MIN_CACHING_TIME,
-                var_InheritInteger(p_extractor, "network-caching"));
+            * __MAX(caching,
+                var_InheritInteger(p_extractor,
+                    local ? "file-caching" : "network-caching"));
         break;
+    }
     case STREAM_SET_PAUSE_STATE:
+        try {
+            bool b_pause = (bool) va_arg(args, int);
+            if (b_pause == p_sys->b_paused)
+                break;
+
+            if (b_pause)
+                // Fill up the buffer, then leave the swarm alone once other
+                // readers of the download are paused too
+                with_download(p_sys, [&](auto& dl) {
+                    dl.pause(p_sys->i_file, (int64_t) p_sys->i_pos,
+                        p_sys->readahead.window(),
+                        get_pause_upload_limit(VLC_OBJECT(p_extractor)));
+                });
+            else
+                with_download(p_sys, [](auto& dl) { dl.resume(); });
+
+            p_sys->b_paused = b_pause;
+        } catch (std::runtime_error& e) {
+            msg_Dbg(p_extractor, "Pause failed: %s", e.what());
+        }
         break;
     case STREAM_GET_SIZE:
-        *va_arg(args, uint64_t*)
-            = p_sys->p_download->get_file(p_extractor->identifier).second;
+        try {
+            *va_arg(args, uint64_t*) = with_download(p_sys, [&](auto& dl) {
+                return dl.get_file(p_extractor->identifier).second;
+            });
+        } catch (std::runtime_error& e) {
+            msg_Dbg(p_extractor, "Get size failed: %s", e.what());
+            return VLC_EGENERIC;
+        }
         break;
     default:
         return VLC_EGENERIC;
@@ -140,7 +439,7 @@ DataOpen(vlc_object_t* p_obj)
     msg_Info(p_extractor, "Opening %s", p_extractor->identifier);
 
     // Temporary buffer to hold metadata
-    auto md = std::make_unique<char[]>(0x100000);
+    auto md = BufferPool::get().acquire(0x100000);
 
     ssize_t mdsz = vlc_stream_Read(p_extractor->source, md.get(), 0x100000);
     if (mdsz < 0)
@@ -149,20 +448,105 @@ DataOpen(vlc_object_t* p_obj)
     auto p_sys = std::make_unique<data_sys>();
 
     try {
-        p_sys->p_download = Download::get_download(md.get(), (size_t) mdsz,
-            get_download_directory(p_obj), get_keep_files(p_obj));
-
-        msg_Dbg(p_extractor, "Added download");
-
-        p_sys->i_file
-            = p_sys->p_download->get_file(p_extractor->identifier).first;
+        std::string socket_path = get_daemon_socket(p_obj);
+
+        if (!socket_path.empty()) {
+            try {
+                p_sys->p_remote = std::make_unique<RemoteDownload>(
+                    socket_path, md.get(), (size_t) mdsz, [] {
+                        return vlc_killed();
+                    });
+
+                msg_Dbg(p_extractor, "Attached to daemon at %s",
+                    socket_path.c_str());
+            } catch (std::runtime_error& e) {
+                msg_Warn(p_extractor, "Daemon unavailable, downloading "
+                    "in-process: %s", e.what());
+            }
+        }
+
+        if (!p_sys->p_remote) {
+            configure_session(p_obj);
+
+            p_sys->p_download = Download::get_download(md.get(),
+                (size_t) mdsz, get_download_directory(p_obj),
+                get_keep_files(p_obj),
+                Download::get_storage_mode(get_storage_mode(p_obj)),
+                get_selective_files(p_obj));
+
+            msg_Dbg(p_extractor, "Added download");
+        }
+
+        p_sys->i_file = with_download(p_sys.get(), [&](auto& dl) {
+            return dl.get_file(p_extractor->identifier).first;
+        });
 
         msg_Dbg(p_extractor, "Found file %d", p_sys->i_file);
+
+        int file = p_sys->i_file;
+        with_download(p_sys.get(), [&](auto& dl) { dl.open_file(file); });
     } catch (std::runtime_error& e) {
         msg_Err(p_extractor, "Failed to add download: %s", e.what());
         return VLC_EGENERIC;
     }
 
+    try {
+        int file = p_sys->i_file;
+
+        // The player looks for subtitles next to the file before playing
+        int n = with_download(
+            p_sys.get(), [&](auto& dl) { return dl.prefetch_sidecars(file); });
+        if (n > 0)
+            msg_Dbg(p_extractor, "Prefetching %d subtitle files", n);
+    } catch (std::runtime_error& e) {
+        msg_Dbg(p_extractor, "Failed to prefetch subtitles: %s", e.what());
+    }
+
+    try {
+        int file = p_sys->i_file;
+
+        int64_t filesz = (int64_t) with_download(p_sys.get(), [&](auto& dl) {
+            return dl.get_file(p_extractor->identifier).second;
+        });
+
+        if (p_sys->p_download) {
+            // The pieces the probe needs may take a while to arrive, so
+            // don't make the player wait for them
+            std::shared_ptr<Download> dl = p_sys->p_download;
+            std::atomic<bool>* closing = &p_sys->b_closing;
+
+            p_sys->probe_thread = std::thread([=] {
+                fetch_index(p_extractor, *dl, file, filesz,
+                    [&](int64_t off, char* buf, size_t buflen) {
+                        return read_unless_closed(
+                            *dl, *closing, file, off, buf, buflen);
+                    });
+            });
+        } else {
+            // Reads through the daemon block, so only look at what's there
+            RemoteDownload& dl = *p_sys->p_remote;
+
+            fetch_index(p_extractor, dl, file, filesz,
+                [&](int64_t off, char* buf, size_t buflen) {
+                    if (!dl.is_local(file, off, (int64_t) buflen))
+                        throw std::runtime_error("Not downloaded yet");
+                    return dl.read(file, off, buf, buflen);
+                });
+        }
+    } catch (std::runtime_error& e) {
+        msg_Dbg(p_extractor, "Failed to probe index: %s", e.what());
+    }
+
+    std::string trace_path = get_trace_file(p_obj);
+    if (!trace_path.empty()) {
+        try {
+            p_sys->p_trace = TraceWriter::get(trace_path);
+            p_sys->i_stream = p_sys->p_trace->new_stream();
+        } catch (std::runtime_error& e) {
+            msg_Warn(p_extractor, "Not tracing: %s", e.what());
+        }
+    }
+
     p_extractor->p_sys = p_sys.release();
     p_extractor->pf_read = DataRead;
     p_extractor->pf_control = DataControl;
@@ -182,4 +566,46 @@ DataClose(vlc_object_t* p_obj)
     data_sys* p_sys = (data_sys*) p_extractor->p_sys;
 
     std::unique_ptr<data_sys> sys(p_sys);
+
+    if (sys && sys->probe_thread.joinable()) {
+        sys->b_closing = true;
+        sys->probe_thread.join();
+    }
+
+    if (!sys || (!sys->p_download && !sys->p_remote))
+        return;
+
+    if (sys->p_prefetch)
+        sys->p_download->cancel_read(sys->p_prefetch->i_id);
+
+    std::string stats;
+    try {
+        int file = sys->i_file;
+        if (sys->b_paused)
+            with_download(sys.get(), [](auto& dl) { dl.resume(); });
+        with_download(sys.get(), [&](auto& dl) { dl.close_file(file); });
+
+        // The statistics cover the download since it was added, with reads
+        // of every stream on it, so only the last stream to close it writes
+        // them. The daemon sends none unless this is the last client.
+        if (!sys->p_download || sys->p_download.use_count() == 1)
+            stats = with_download(
+                sys.get(), [](auto& dl) { return dl.get_stats(); });
+    } catch (std::runtime_error& e) {
+        msg_Dbg(p_extractor, "Stats failed: %s", e.what());
+        return;
+    }
+
+    if (stats.empty())
+        return;
+
+    std::istringstream is(stats);
+    for (std::string line; std::getline(is, line);)
+        msg_Dbg(p_extractor, "Stats: %s", line.c_str());
+
+    std::string path = get_stats_file(p_obj);
+    if (!path.empty()) {
+        std::ofstream os(path, std::ios::app);
+        os << "# " << p_extractor->identifier << "\n" << stats;
+    }
 }
@@ -27,7 +27,9 @@ XXX: This file is basically just glue code so vlc can make interruptible
 #endif
 
 #include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <future>
 #include <limits>
@@ -35,6 +37,11 @@ XXX: This file is basically just glue code so vlc can make interruptible
 #include <mutex>
 #include <stdexcept>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "download.h"
 
 #pragma GCC diagnostic push
@@ -53,6 +60,7 @@ XXX: This file is basically just glue code so vlc can make interruptible
 #include <libtorrent/version.hpp>
 #pragma GCC diagnostic pop
 
+#include "bufferpool.h"
 #include "vlc.h"
 
 #define D(x)
@@ -61,10 +69,30 @@ XXX: This file is basically just glue code so vlc can make interruptible
 #define kB (1024)
 #define MB (1024 * kB)
 
+// Subtitle files bigger than this aren't worth prefetching
+#define SIDECAR_MAX_SIZE (4 * MB)
+
+// Disk space reserved at a time in region storage mode
+#define REGION_SIZE (16 * MB)
+
+#define BLOCK_SIZE (16 * kB)
+
+// Most pieces being fetched from web seeds at the same time
+#define WEB_SEED_FETCHES 2
+
+// How long to wait for a piece read before asking libtorrent again
+#define READ_PIECE_RETRY std::chrono::seconds(5)
+
 #define PRIO_HIGHEST 7
 #define PRIO_HIGHER 6
 #define PRIO_HIGH 5
 
+// Read-ahead window when the caller has no better idea
+#define READAHEAD_DEFAULT (32 * MB)
+
+// Most recently read pieces kept per download, if memory budget allows
+#define PIECE_CACHE_SIZE (32 * MB)
+
 namespace lt = libtorrent;
 
 static std::string
@@ -89,6 +117,13 @@ normalize_path(const std::string& path)
     return result;
 }
 
+static std::chrono::microseconds
+elapsed(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - since);
+}
+
 template <typename T> class vlc_interrupt_guard {
 public:
     vlc_interrupt_guard(T& pr)
@@ -154,12 +189,16 @@ public:
             if (x->piece != m_piece)
                 return;
 
-            if (x->error)
-                set_exception(
-                    std::make_exception_ptr(std::runtime_error("read failed")));
-            else
-                // Read is done
-                set_value(std::make_pair(x->buffer, x->size));
+            // A retried read can complete more than once
+            try {
+                if (x->error)
+                    set_exception(std::make_exception_ptr(
+                        std::runtime_error("read failed")));
+                else
+                    // Read is done
+                    set_value(std::make_pair(x->buffer, x->size));
+            } catch (std::future_error&) {
+            }
         }
     }
 
@@ -171,9 +210,13 @@ private:
 
 class DownloadPiecePromise : public std::promise<void>, public Alert_Listener {
 public:
-    DownloadPiecePromise(lt::sha1_hash ih, int p)
+    DownloadPiecePromise(lt::sha1_hash ih, int p, int blocks, DataProgressCb cb)
         : m_ih(ih)
         , m_piece(p)
+        , m_blocks(blocks)
+        , m_cb(cb)
+        , m_start(std::chrono::steady_clock::now())
+        , m_first_block_us(-1)
     {
     }
 
@@ -189,13 +232,50 @@ public:
 
             // Download is done
             set_value();
+        } else if (auto* x = lt::alert_cast<lt::block_finished_alert>(a)) {
+            if (x->handle.info_hash() != m_ih)
+                return;
+
+            if (x->piece_index != m_piece)
+                return;
+
+            // End game mode can deliver a block more than once
+            if (!m_finished.insert(x->block_index).second)
+                return;
+
+            if (m_first_block_us < 0)
+                m_first_block_us = elapsed(m_start).count();
+
+            if (m_cb)
+                m_cb(100.0f * (float) m_finished.size()
+                    / (float) std::max(m_blocks, 1));
         }
     }
 
+    /**
+     * Time until the first block of the piece arrived, or -1 if none did.
+     */
+    std::chrono::microseconds
+    first_block()
+    {
+        return std::chrono::microseconds(m_first_block_us);
+    }
+
 private:
     lt::sha1_hash m_ih;
 
     int m_piece;
+
+    int m_blocks;
+
+    DataProgressCb m_cb;
+
+    std::chrono::steady_clock::time_point m_start;
+
+    // Only touched by the alert thread
+    std::set<int> m_finished;
+
+    std::atomic<int64_t> m_first_block_us;
 };
 
 class MetadataDownloadPromise : public std::promise<void>,
@@ -234,6 +314,26 @@ private:
     lt::sha1_hash m_ih;
 };
 
+// Registry of running downloads, split up so that lookups of different
+// torrents rarely wait on each other
+#define REGISTRY_SHARDS 16
+
+struct RegistryEntry {
+    // Held by the Download of this torrent for as long as it lives
+    std::shared_ptr<std::mutex> mtx;
+
+    std::weak_ptr<Download> dl;
+
+    // Valid while the Download is being created
+    std::shared_future<std::shared_ptr<Download>> pending;
+};
+
+struct RegistryShard {
+    std::mutex mtx;
+
+    std::map<lt::sha1_hash, RegistryEntry> entries;
+};
+
 class RemovePromise : public std::promise<void>, public Alert_Listener {
 public:
     RemovePromise(lt::sha1_hash ih)
@@ -257,18 +357,50 @@ private:
     lt::sha1_hash m_ih;
 };
 
-Download::Download(std::mutex& mtx, lt::add_torrent_params& atp, bool k)
-    : m_lock(mtx)
+Download::Download(std::shared_ptr<std::mutex> mtx,
+    lt::add_torrent_params& atp, bool k, StorageMode mode, bool selective)
+    : m_lock_mtx(mtx)
+    , m_lock(*mtx)
     , m_keep(k)
+    , m_paused(false)
+    , m_paused_upload_limit(-1)
+    , m_upload_capped(false)
+    , m_pause_count(0)
+    , m_pause_upload_limit(0)
+    , m_readers(0)
+    , m_web_seeds_loaded(false)
+    , m_read_id(0)
+    , m_closing(false)
+    , m_selective(selective)
+    , m_files_changed(false)
+    , m_storage_mode(mode)
+    , m_region_working(false)
+    , m_timeline(Timeline::get())
     , m_session(Session::get())
+    , m_cache(m_session->memory(), PIECE_CACHE_SIZE)
 {
     D(printf("%s:%d: %s (from atp)\n", __FILE__, __LINE__, __func__));
 
+    m_session->tune_for_storage(atp.save_path);
+
+    // Region mode starts out sparse and fills in as playback goes
+    atp.storage_mode = mode == StorageMode::Allocate
+        ? lt::storage_mode_allocate
+        : lt::storage_mode_sparse;
+
+    // Nothing is wanted until a reader attaches to a file
+    if (selective && atp.ti)
+        atp.file_priorities.assign(
+            (size_t) atp.ti->num_files(), lt::dont_download);
+
     // Doesn't matter if it's duplicate since we never remove torrents
     m_th = m_session->add_torrent(atp);
     if (!m_th.is_valid())
         throw std::runtime_error("Failed to add torrent");
 
+    // Async reads are completed from alerts
+    m_session->register_alert_listener(this);
+
     // Need to give libtorrent some time to breethe
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
 }
@@ -277,6 +409,32 @@ Download::~Download()
 {
     D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
 
+    m_closing = true;
+
+    // No alert can complete a read after this, so nobody is left to care
+    // about waiting ones
+    m_session->unregister_alert_listener(this);
+
+    for (auto& r : m_reads)
+        r.second.completion(-1,
+            std::make_exception_ptr(std::runtime_error("Read cancelled")));
+
+    // Fetches use the torrent handle, so let them finish first, which
+    // cancelling makes quick. The region worker stops after the piece at
+    // hand.
+    {
+        std::unique_lock<std::mutex> lock(m_web_seed_mtx);
+
+        for (auto& ws : m_web_seeds)
+            ws->cancel();
+    }
+
+    for (auto& f : m_web_seed_fetches)
+        f.wait();
+
+    if (m_region_worker.valid())
+        m_region_worker.wait();
+
     if (m_th.is_valid()) {
         RemovePromise rmprom(m_th.info_hash());
         AlertSubscriber<RemovePromise> sub(m_session, &rmprom);
@@ -294,11 +452,24 @@ ssize_t
 Download::read(int file, int64_t fileoff, char* buf, size_t buflen,
     DataProgressCb progress_cb)
 {
-    D(printf("%s:%d: %s(%d, %lu, %p, %lu)\n", __FILE__, __LINE__, __func__,
-        file, fileoff, buf, buflen));
+    return read(file, fileoff, buf, buflen, READAHEAD_DEFAULT, progress_cb);
+}
+
+ssize_t
+Download::read(int file, int64_t fileoff, char* buf, size_t buflen,
+    int64_t window, DataProgressCb progress_cb)
+{
+    D(printf("%s:%d: %s(%d, %lu, %p, %lu, %ld)\n", __FILE__, __LINE__,
+        __func__, file, fileoff, buf, buflen, window));
+
+    auto start = std::chrono::steady_clock::now();
+
+    m_stats.requested();
 
     download_metadata();
 
+    m_stats.add(ReadStats::STAGE_METADATA, elapsed(start));
+
     auto ti = m_th.torrent_file();
 
     auto fs = ti->files();
@@ -320,8 +491,309 @@ Download::read(int file, int64_t fileoff, char* buf, size_t buflen,
     if (part.length <= 0)
         return 0;
 
+    prioritize_read(file, fileoff, part.length, window);
+
+    if (!m_th.have_piece(part.piece)) {
+        auto t = std::chrono::steady_clock::now();
+
+        download(part, progress_cb);
+
+        m_stats.add(ReadStats::STAGE_DOWNLOAD, elapsed(t));
+        m_stats.stall(elapsed(t));
+
+        if (m_timeline)
+            m_timeline->reader_span(m_th.info_hash(),
+                static_cast<int>(part.piece), "blocked", t,
+                std::chrono::steady_clock::now());
+    }
+
+    ssize_t len = read(part, buf, buflen);
+
+    m_stats.served(len > 0 ? (size_t) len : 0);
+    m_stats.add(ReadStats::STAGE_TOTAL, elapsed(start));
+
+    if (m_timeline) {
+        m_timeline->reader_span(m_th.info_hash(),
+            static_cast<int>(part.piece), "read", start,
+            std::chrono::steady_clock::now());
+        m_timeline->piece_event(m_th.info_hash(),
+            static_cast<int>(part.piece), "served", "bytes", len);
+    }
+
+    return len;
+}
+
+uint64_t
+Download::async_read(int file, int64_t off, char* buf, size_t buflen,
+    int64_t window, ReadCompletion completion)
+{
+    D(printf("%s:%d: %s(%d, %ld, %p, %lu, %ld)\n", __FILE__, __LINE__,
+        __func__, file, off, buf, buflen, window));
+
+    auto start = std::chrono::steady_clock::now();
+
+    m_stats.requested();
+
+    uint64_t id;
+    {
+        std::unique_lock<std::mutex> lock(m_read_mtx);
+
+        id = ++m_read_id;
+    }
+
+    lt::peer_request part;
+
+    try {
+        download_metadata();
+
+        m_stats.add(ReadStats::STAGE_METADATA, elapsed(start));
+
+        auto ti = m_th.torrent_file();
+
+        auto fs = ti->files();
+
+        if (file >= fs.num_files() || file < 0)
+            throw std::runtime_error("File not found");
+
+        if (off < 0)
+            throw std::runtime_error("File offset negative");
+
+        int64_t filesz = fs.file_size(file);
+
+        if (off < filesz)
+            part = ti->map_file(file, off,
+                (int) std::min({ (int64_t) std::numeric_limits<int>::max(),
+                    (int64_t) buflen, filesz - off }));
+
+        if (off >= filesz || part.length <= 0) {
+            completion(0, nullptr);
+            return id;
+        }
+
+        prioritize_read(file, off, part.length, window);
+    } catch (...) {
+        completion(-1, std::current_exception());
+        return id;
+    }
+
+    int piece = static_cast<int>(part.piece);
+
+    AsyncRead r = { id, part, buf, buflen, completion, start, {} };
+
+    boost::shared_array<char> piece_buffer;
+    int piece_size;
+
+    // Still in memory from an earlier read
+    if (m_cache.get(piece, piece_buffer, piece_size)) {
+        finish_read(r, piece_buffer.get(), piece_size, {});
+        return id;
+    }
+
+    bool have = m_th.have_piece(part.piece);
+    if (!have)
+        r.missed = std::chrono::steady_clock::now();
+
+    {
+        std::unique_lock<std::mutex> lock(m_read_mtx);
+
+        m_reads.insert({ piece, std::move(r) });
+    }
+
+    // If the piece finishes after the check, its alert finds the read
+    if (have || m_th.have_piece(part.piece)) {
+        issue_read(piece, false);
+    } else {
+        queue_regions(piece);
+        fetch_from_web_seeds(piece);
+        m_th.set_piece_deadline(part.piece, 0);
+    }
+
+    return id;
+}
+
+void
+Download::cancel_read(uint64_t id)
+{
+    D(printf("%s:%d: %s(%lu)\n", __FILE__, __LINE__, __func__, id));
+
+    ReadCompletion completion;
+    {
+        std::unique_lock<std::mutex> lock(m_read_mtx);
+
+        for (auto it = m_reads.begin(); it != m_reads.end(); ++it) {
+            if (it->second.id == id) {
+                completion = std::move(it->second.completion);
+                m_reads.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (completion)
+        completion(-1,
+            std::make_exception_ptr(std::runtime_error("Read cancelled")));
+}
+
+void
+Download::finish_read(AsyncRead& r, const char* piece_buffer, int piece_size,
+    std::chrono::steady_clock::time_point read_start)
+{
+    int piece = static_cast<int>(r.part.piece);
+
+    // The piece was asked for as soon as it was downloaded
+    if (r.missed != std::chrono::steady_clock::time_point()
+        && read_start > r.missed) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            read_start - r.missed);
+
+        m_stats.add(ReadStats::STAGE_DOWNLOAD, us);
+        m_stats.stall(us);
+
+        if (m_timeline)
+            m_timeline->reader_span(
+                m_th.info_hash(), piece, "blocked", r.missed, read_start);
+    }
+
+    int len = std::min({ piece_size - r.part.start, (int) r.buflen,
+        r.part.length });
+    if (len < 0) {
+        r.completion(-1, nullptr);
+        return;
+    }
+
+    auto t = std::chrono::steady_clock::now();
+
+    memcpy(r.buf, piece_buffer + r.part.start, (size_t) len);
+
+    m_stats.add(ReadStats::STAGE_COPY, elapsed(t));
+
+    m_stats.served((size_t) len);
+    m_stats.add(ReadStats::STAGE_TOTAL, elapsed(r.start));
+
+    if (m_timeline) {
+        m_timeline->reader_span(m_th.info_hash(), piece, "read", r.start,
+            std::chrono::steady_clock::now());
+        m_timeline->piece_event(
+            m_th.info_hash(), piece, "served", "bytes", len);
+    }
+
+    r.completion(len, nullptr);
+}
+
+void
+Download::issue_read(int piece, bool force)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_read_mtx);
+
+        if (m_reads.find(piece) == m_reads.end())
+            return;
+
+        if (!force && m_reading.count(piece))
+            return;
+
+        m_reading[piece] = std::chrono::steady_clock::now();
+    }
+
+    m_th.read_piece(lt::piece_index_t(piece));
+}
+
+void
+Download::handle_alert(lt::alert* a)
+{
+    if (auto* x = lt::alert_cast<lt::block_downloading_alert>(a)) {
+        // Requested from a peer, for whatever reason its priority was
+        // raised, so it gets written soon
+        if (x->handle == m_th)
+            queue_regions(static_cast<int>(x->piece_index));
+    } else if (auto* x = lt::alert_cast<lt::piece_finished_alert>(a)) {
+        if (x->handle != m_th)
+            return;
+
+        issue_read(static_cast<int>(x->piece_index), false);
+    } else if (auto* x = lt::alert_cast<lt::read_piece_alert>(a)) {
+        if (x->handle != m_th)
+            return;
+
+        int piece = static_cast<int>(x->piece);
+
+        // Blocking reads of the piece end up here too, and complete ours
+        std::vector<AsyncRead> done;
+        std::chrono::steady_clock::time_point read_start;
+        {
+            std::unique_lock<std::mutex> lock(m_read_mtx);
+
+            auto range = m_reads.equal_range(piece);
+            for (auto it = range.first; it != range.second; ++it)
+                done.push_back(std::move(it->second));
+            m_reads.erase(range.first, range.second);
+
+            auto it = m_reading.find(piece);
+            if (it != m_reading.end()) {
+                read_start = it->second;
+                m_reading.erase(it);
+            }
+        }
+
+        if (done.empty())
+            return;
+
+        if (x->error) {
+            for (auto& r : done)
+                r.completion(-1,
+                    std::make_exception_ptr(std::runtime_error("read failed")));
+            return;
+        }
+
+        if (read_start != std::chrono::steady_clock::time_point()) {
+            m_stats.add(ReadStats::STAGE_DISK, elapsed(read_start));
+
+            if (m_timeline)
+                m_timeline->piece_span(m_th.info_hash(), piece, "read_piece",
+                    read_start, std::chrono::steady_clock::now());
+        }
+
+        m_cache.put(piece, x->buffer, x->size);
+
+        for (auto& r : done)
+            finish_read(r, x->buffer.get(), x->size, read_start);
+    } else if (lt::alert_cast<lt::session_stats_alert>(a)) {
+        // Comes every few seconds. Alerts are lost if the queue overflows,
+        // so look again at pieces that have been waited on for a while.
+        auto now = std::chrono::steady_clock::now();
+
+        std::vector<int> stale, unread;
+        {
+            std::unique_lock<std::mutex> lock(m_read_mtx);
+
+            for (auto& r : m_reads) {
+                auto it = m_reading.find(r.first);
+                if (it == m_reading.end())
+                    unread.push_back(r.first);
+                else if (now - it->second >= READ_PIECE_RETRY)
+                    stale.push_back(r.first);
+            }
+        }
+
+        stale.erase(std::unique(stale.begin(), stale.end()), stale.end());
+        unread.erase(std::unique(unread.begin(), unread.end()), unread.end());
+
+        for (int piece : stale)
+            issue_read(piece, true);
+
+        for (int piece : unread)
+            if (m_th.have_piece(lt::piece_index_t(piece)))
+                issue_read(piece, false);
+    }
+}
+
+void
+Download::prioritize_read(int file, int64_t off, int length, int64_t window)
+{
+    int64_t filesz = m_th.torrent_file()->files().file_size(file);
+
     // Set highest priority to the requested range
-    set_piece_priority(file, fileoff, part.length, PRIO_HIGHEST);
+    set_piece_priority(file, off, length, PRIO_HIGHEST);
 
     // Set second highest priority to the first and last 0.1% or 64 kB
     int64_t p01 = std::max(
@@ -330,16 +802,294 @@ Download::read(int file, int64_t fileoff, char* buf, size_t buflen,
     set_piece_priority(file, 0, (int) p01, PRIO_HIGHER);
     set_piece_priority(file, filesz - p01, (int) p01, PRIO_HIGHER);
 
-    // Set third highest priority to the next 5% or 64 MB
-    int64_t p5 = std::max(
-        std::min((int64_t) std::numeric_limits<int>::max(), 5 * filesz / 100),
-        (int64_t) 32 * MB);
-    set_piece_priority(file, fileoff, (int) p5, PRIO_HIGH);
+    // Set third highest priority to the read-ahead window
+    set_piece_priority(file, off,
+        (int) std::min((int64_t) std::numeric_limits<int>::max(),
+            std::max(window, (int64_t) length)),
+        PRIO_HIGH);
+}
 
-    if (!m_th.have_piece(part.piece))
-        download(part, progress_cb);
+void
+Download::pause(int file, int64_t off, int64_t window, int upload_limit)
+{
+    D(printf("%s:%d: %s(%d, %ld, %ld, %d)\n", __FILE__, __LINE__, __func__,
+        file, off, window, upload_limit));
 
-    return read(part, buf, buflen);
+    download_metadata();
+
+    auto ti = m_th.torrent_file();
+
+    const lt::file_storage& fs = ti->files();
+
+    if (file >= fs.num_files() || file < 0)
+        throw std::runtime_error("File not found");
+
+    int64_t filesz = fs.file_size(file);
+    off = std::max(std::min(off, filesz), (int64_t) 0);
+    int size = (int) std::min({ (int64_t) std::numeric_limits<int>::max(),
+        window, filesz - off });
+
+    std::unique_lock<std::mutex> lock(m_pause_mtx);
+
+    m_pause_windows.push_back(ti->map_file(file, off, size));
+    m_pause_upload_limit = upload_limit;
+    m_pause_count++;
+
+    update_pause();
+}
+
+void
+Download::resume()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::unique_lock<std::mutex> lock(m_pause_mtx);
+
+    if (m_pause_count > 0)
+        m_pause_count--;
+
+    // Windows of readers that resumed can't be told apart, so they are
+    // kept until nobody is paused
+    if (m_pause_count == 0)
+        m_pause_windows.clear();
+
+    update_pause();
+}
+
+// Called with m_pause_mtx held
+void
+Download::update_pause()
+{
+    bool pause = m_pause_count > 0 && m_pause_count >= m_readers;
+    if (pause == m_paused)
+        return;
+
+    if (pause) {
+        auto ti = m_th.torrent_file();
+
+        m_paused_priorities = m_th.get_piece_priorities();
+
+        // Don't request anything except what's left to fill the buffers
+        std::vector<lt::download_priority_t> prios(
+            m_paused_priorities.size(), lt::dont_download);
+        for (auto part : m_pause_windows) {
+            for (; part.length > 0;
+                 part.length -= ti->piece_size(part.piece++)) {
+                auto i = (size_t) static_cast<int>(part.piece);
+                if (i < prios.size())
+                    prios[i] = std::max(m_paused_priorities[i],
+                        lt::download_priority_t(PRIO_HIGH));
+            }
+        }
+        m_th.prioritize_pieces(prios);
+
+        if (m_pause_upload_limit > 0) {
+            m_paused_upload_limit = m_th.upload_limit();
+            m_th.set_upload_limit(m_pause_upload_limit);
+            m_upload_capped = true;
+        }
+
+        m_paused = true;
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> file_lock(m_file_mtx);
+
+        // Files opened or closed while paused change what is wanted, so
+        // start from the files then. Either way the priorities from before
+        // pausing end up in effect.
+        if (m_files_changed)
+            apply_file_priorities(m_paused_priorities);
+        else
+            m_th.prioritize_pieces(m_paused_priorities);
+
+        m_files_changed = false;
+    }
+
+    // -1 means there was no limit, which is restored like any other
+    if (m_upload_capped)
+        m_th.set_upload_limit(m_paused_upload_limit);
+
+    m_upload_capped = false;
+
+    m_paused_priorities.clear();
+    m_paused_upload_limit = -1;
+
+    m_paused = false;
+}
+
+void
+Download::open_file(int file)
+{
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, file));
+
+    download_metadata();
+
+    {
+        std::unique_lock<std::mutex> lock(m_file_mtx);
+
+        m_readers++;
+
+        // Pausing has its own idea of what to download, resuming catches up
+        if (m_file_refs[file]++ == 0 && m_selective) {
+            if (m_paused)
+                m_files_changed = true;
+            else
+                apply_file_priorities(m_th.get_piece_priorities());
+        }
+    }
+
+    // Not all readers are paused anymore
+    std::unique_lock<std::mutex> lock(m_pause_mtx);
+    update_pause();
+}
+
+void
+Download::close_file(int file)
+{
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, file));
+
+    {
+        std::unique_lock<std::mutex> lock(m_file_mtx);
+
+        auto it = m_file_refs.find(file);
+        if (it == m_file_refs.end())
+            return;
+
+        m_readers--;
+
+        if (--it->second == 0) {
+            m_file_refs.erase(it);
+
+            if (m_selective && m_paused)
+                m_files_changed = true;
+            else if (m_selective)
+                apply_file_priorities(m_th.get_piece_priorities());
+        }
+    }
+
+    // The readers left may all be paused
+    std::unique_lock<std::mutex> lock(m_pause_mtx);
+    update_pause();
+}
+
+// Called with m_file_mtx held
+void
+Download::apply_file_priorities(
+    const std::vector<lt::download_priority_t>& keep)
+{
+    auto ti = m_th.torrent_file();
+    if (!ti)
+        return;
+
+    std::vector<lt::download_priority_t> prios(
+        (size_t) ti->num_files(), lt::dont_download);
+    for (auto& f : m_file_refs) {
+        if (f.first >= 0 && (size_t) f.first < prios.size())
+            prios[(size_t) f.first] = lt::default_priority;
+    }
+
+    // libtorrent gives a piece spanning two files the higher of their
+    // priorities, so a piece shared with an open file stays wanted
+    m_th.prioritize_files(prios);
+
+    // That sets every piece priority from the files, dropping what reads
+    // and prefetches raised, in this file or any other. Put those back.
+    auto pieces = m_th.get_piece_priorities();
+    bool raised = false;
+    for (size_t i = 0; i < pieces.size() && i < keep.size(); i++) {
+        if (keep[i] > lt::default_priority && keep[i] > pieces[i]) {
+            pieces[i] = keep[i];
+            raised = true;
+        }
+    }
+    if (raised)
+        m_th.prioritize_pieces(pieces);
+}
+
+std::string
+Download::get_stats()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::string stats = m_stats.dump();
+
+    stats += "swarm: "
+        + std::to_string(
+            m_th.status(lt::status_flags_t {}).total_payload_download)
+        + " bytes\n";
+
+    {
+        std::unique_lock<std::mutex> lock(m_web_seed_mtx);
+
+        for (auto& ws : m_web_seeds)
+            stats += ws->get_stats();
+    }
+
+    if (auto ti = m_th.torrent_file()) {
+        auto ih = ti->info_hashes();
+
+        stats += "pieces: " + std::to_string(ti->piece_length()) + " bytes ("
+            + std::to_string(ti->piece_length() / BLOCK_SIZE) + " blocks), "
+            + (ih.has_v2() ? (ih.has_v1() ? "hybrid" : "v2") : "v1") + "\n";
+    }
+
+    if (m_storage_mode == StorageMode::Region) {
+        std::unique_lock<std::mutex> lock(m_region_mtx);
+
+        stats += "storage: " + std::to_string(m_regions.size())
+            + " regions allocated\n";
+    }
+
+    return stats + m_session->get_stats() + BufferPool::get().get_stats();
+}
+
+int64_t
+Download::get_download_rate()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    return m_th.status(lt::status_flags_t {}).download_payload_rate;
+}
+
+int
+Download::get_num_peers()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    return m_th.status(lt::status_flags_t {}).num_peers;
+}
+
+bool
+Download::is_local(int file, int64_t off, int64_t size)
+{
+    D(printf("%s:%d: %s(%d, %ld, %ld)\n", __FILE__, __LINE__, __func__, file,
+        off, size));
+
+    auto ti = m_th.torrent_file();
+    if (!ti)
+        return false;
+
+    const lt::file_storage& fs = ti->files();
+
+    if (file >= fs.num_files() || file < 0)
+        throw std::runtime_error("File not found");
+
+    int64_t filesz = fs.file_size(file);
+    off = std::max(std::min(off, filesz), (int64_t) 0);
+    size = std::min({ (int64_t) std::numeric_limits<int>::max(), size,
+        filesz - off });
+    if (size <= 0)
+        return true;
+
+    auto part = ti->map_file(file, off, (int) size);
+    for (; part.length > 0; part.length -= ti->piece_size(part.piece++)) {
+        if (!m_th.have_piece(part.piece))
+            return false;
+    }
+
+    return true;
 }
 
 void
@@ -362,11 +1112,140 @@ Download::set_piece_priority(int file, int64_t off, int size, libtorrent::downlo
     auto part = ti->map_file(file, off, size);
     for (; part.length > 0; part.length -= ti->piece_size(part.piece++)) {
         if (!m_th.have_piece(part.piece)
-            && m_th.piece_priority(part.piece) < prio)
+            && m_th.piece_priority(part.piece) < prio) {
             m_th.piece_priority(part.piece, prio);
+
+            if (m_timeline)
+                m_timeline->prioritized(m_th.info_hash(),
+                    static_cast<int>(part.piece),
+                    static_cast<std::uint8_t>(prio));
+        }
     }
 }
 
+void
+Download::prefetch(int file, int64_t off, int64_t size)
+{
+    D(printf("%s:%d: %s(%d, %ld, %ld)\n", __FILE__, __LINE__, __func__, file,
+        off, size));
+
+    download_metadata();
+
+    const lt::file_storage& fs = m_th.torrent_file()->files();
+
+    if (file >= fs.num_files() || file < 0)
+        throw std::runtime_error("File not found");
+
+    if (off < 0 || size <= 0)
+        return;
+
+    set_piece_priority(file, off,
+        (int) std::min((int64_t) std::numeric_limits<int>::max(), size),
+        PRIO_HIGHEST);
+}
+
+// Split a path into directory and file name
+static void
+split_path(const std::string& path, std::string& dir, std::string& name)
+{
+    size_t slash = path.find_last_of("/\\");
+    if (slash == std::string::npos) {
+        dir.clear();
+        name = path;
+    } else {
+        dir = path.substr(0, slash);
+        name = path.substr(slash + 1);
+    }
+}
+
+int
+Download::prefetch_sidecars(int file)
+{
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, file));
+
+    static const std::set<std::string> extensions
+        = { "srt", "ass", "ssa", "idx", "sub", "vtt", "smi" };
+
+    download_metadata();
+
+    const lt::file_storage& fs = m_th.torrent_file()->files();
+
+    if (file >= fs.num_files() || file < 0)
+        throw std::runtime_error("File not found");
+
+    std::string dir, name;
+    split_path(fs.file_path(file), dir, name);
+
+    std::string stem = name.substr(0, name.rfind('.'));
+
+    struct Sidecar {
+        int file;
+        // Name without the extension
+        std::string base;
+        std::string ext;
+    };
+
+    std::vector<Sidecar> matches;
+
+    for (int i = 0; i < fs.num_files(); i++) {
+        if (i == file || fs.pad_file_at(i))
+            continue;
+
+        if (fs.file_size(i) <= 0)
+            continue;
+
+        std::string sdir, sname;
+        split_path(fs.file_path(i), sdir, sname);
+        if (sdir != dir)
+            continue;
+
+        // Stem followed by a language or nothing, then the extension
+        size_t dot = sname.rfind('.');
+        if (dot == std::string::npos || dot < stem.size()
+            || sname.compare(0, stem.size(), stem) != 0
+            || sname[stem.size()] != '.')
+            continue;
+
+        std::string ext = sname.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+            [](unsigned char c) { return (char) std::tolower(c); });
+        if (!extensions.count(ext))
+            continue;
+
+        matches.push_back({ i, sname.substr(0, dot), ext });
+    }
+
+    // VobSub comes as an .idx and a .sub that is useless without it and
+    // may be large, so they are fetched together whatever the size
+    std::set<std::string> vobsub;
+    for (auto& m : matches)
+        if (m.ext == "idx")
+            vobsub.insert(m.base);
+
+    int n = 0;
+
+    for (auto& m : matches) {
+        int i = m.file;
+        int64_t size = fs.file_size(i);
+
+        bool pair
+            = (m.ext == "idx" || m.ext == "sub") && vobsub.count(m.base);
+        if (!pair && size > SIDECAR_MAX_SIZE)
+            continue;
+
+        D(printf("%s:%d: %s: prefetch %s\n", __FILE__, __LINE__, __func__,
+            fs.file_path(i).c_str()));
+
+        set_piece_priority(i, 0,
+            (int) std::min((int64_t) std::numeric_limits<int>::max(), size),
+            PRIO_HIGHEST);
+
+        n++;
+    }
+
+    return n;
+}
+
 std::vector<std::pair<std::string, uint64_t>>
 Download::get_files()
 {
@@ -406,6 +1285,27 @@ Download::get_files(char* metadata, size_t metadatasz)
     return files;
 }
 
+// static
+void
+Download::visit_files(char* metadata, size_t metadatasz, FileVisitor visitor)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    lt::error_code ec;
+
+    lt::torrent_info ti(metadata, (int) metadatasz, ec);
+    if (ec)
+        throw std::runtime_error("Failed to parse metadata");
+
+    const lt::file_storage& fs = ti.files();
+    for (int i = 0; i < fs.num_files(); i++) {
+        if (fs.pad_file_at(i))
+            continue;
+
+        visitor(normalize_path(fs.file_path(i)), (uint64_t) fs.file_size(i));
+    }
+}
+
 // static
 std::shared_ptr<std::vector<char>>
 Download::get_metadata(std::string url, std::string save_path,
@@ -444,7 +1344,8 @@ Download::get_metadata(std::string url, std::string save_path,
             atp.ti = NULL;
 
             // Dowload metadata
-            auto metadata = Download::get_download(atp, true)->get_metadata(cb);
+            auto metadata = Download::get_download(atp, true,
+                StorageMode::Sparse, false)->get_metadata(cb);
 
             // Write metadata to cache
             std::ofstream os(path, std::ios::binary);
@@ -472,28 +1373,81 @@ Download::get_metadata(std::string url, std::string save_path,
 
 // static
 std::shared_ptr<Download>
-Download::get_download(lt::add_torrent_params& atp, bool k)
+Download::get_download(lt::add_torrent_params& atp, bool k,
+    StorageMode mode, bool selective)
 {
     D(printf("%s:%d: %s (from atp)\n", __FILE__, __LINE__, __func__));
 
     lt::sha1_hash ih = atp.ti ? atp.ti->info_hash() : atp.info_hashes.get_best();
 
-    static std::mutex mtx;
-    std::unique_lock<std::mutex> lock(mtx);
+    static RegistryShard shards[REGISTRY_SHARDS];
+    RegistryShard& shard
+        = shards[std::hash<lt::sha1_hash>()(ih) % REGISTRY_SHARDS];
+
+    std::promise<std::shared_ptr<Download>> prom;
+    std::shared_future<std::shared_ptr<Download>> pending;
+    std::shared_ptr<std::mutex> mtx;
+
+    {
+        std::unique_lock<std::mutex> lock(shard.mtx);
+
+        // Forget torrents that are gone, unless still being removed
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            RegistryEntry& e = it->second;
+            if (it->first != ih && !e.pending.valid() && e.dl.expired()
+                && e.mtx.use_count() == 1)
+                it = shard.entries.erase(it);
+            else
+                ++it;
+        }
+
+        // Re-use Download instance if possible, else create new instance
+        RegistryEntry& e = shard.entries[ih];
+        if (auto dl = e.dl.lock())
+            return dl;
+
+        if (e.pending.valid()) {
+            // Someone else is creating it
+            pending = e.pending;
+        } else {
+            if (!e.mtx)
+                e.mtx = std::make_shared<std::mutex>();
+
+            mtx = e.mtx;
+            e.pending = prom.get_future().share();
+        }
+    }
+
+    if (pending.valid())
+        return pending.get();
+
+    // Adding the torrent takes a while, so don't hold up other torrents
+    std::shared_ptr<Download> dl;
+    try {
+        dl = std::make_shared<Download>(mtx, atp, k, mode, selective);
+    } catch (...) {
+        prom.set_exception(std::current_exception());
+
+        std::unique_lock<std::mutex> lock(shard.mtx);
+        shard.entries[ih].pending = {};
+        throw;
+    }
 
-    // Re-use Download instance if possible, else create new instance
-    static std::map<lt::sha1_hash, std::weak_ptr<Download>> dls;
-    static std::map<lt::sha1_hash, std::mutex> dls_mtx;
-    std::shared_ptr<Download> dl = dls[ih].lock();
-    if (!dl)
-        dls[ih] = dl = std::make_shared<Download>(dls_mtx[ih], atp, k);
+    prom.set_value(dl);
+
+    std::unique_lock<std::mutex> lock(shard.mtx);
+
+    RegistryEntry& e = shard.entries[ih];
+    e.dl = dl;
+    e.pending = {};
 
     return dl;
 }
 
 // static
 std::shared_ptr<Download>
-Download::get_download(char* md, size_t mdsz, std::string sp, bool k)
+Download::get_download(char* md, size_t mdsz, std::string sp, bool k,
+    StorageMode mode, bool selective)
 {
     D(printf("%s:%d: %s (from buf)\n", __FILE__, __LINE__, __func__));
 
@@ -512,7 +1466,21 @@ Download::get_download(char* md, size_t mdsz, std::string sp, bool k)
     if (ec)
         throw std::runtime_error("Failed to parse metadata");
 
-    return Download::get_download(atp, k);
+    return Download::get_download(atp, k, mode, selective);
+}
+
+// static
+StorageMode
+Download::get_storage_mode(const std::string& name)
+{
+    if (name.empty() || name == "sparse")
+        return StorageMode::Sparse;
+    else if (name == "allocate")
+        return StorageMode::Allocate;
+    else if (name == "region")
+        return StorageMode::Region;
+
+    throw std::runtime_error("Unknown storage mode " + name);
 }
 
 std::pair<int, uint64_t>
@@ -609,28 +1577,279 @@ Download::download(lt::peer_request part, DataProgressCb cb)
     if (m_th.have_piece(part.piece))
         return;
 
-    DownloadPiecePromise dlprom(m_th.info_hash(), part.piece);
+    auto ti = m_th.torrent_file();
+
+    int blocks = (ti->piece_size(part.piece) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    DownloadPiecePromise dlprom(m_th.info_hash(), part.piece, blocks, cb);
     AlertSubscriber<DownloadPiecePromise> sub(m_session, &dlprom);
     vlc_interrupt_guard<DownloadPiecePromise> intrguard(dlprom);
 
     auto f = dlprom.get_future();
 
+    // Reserve space before libtorrent starts writing the piece
+    allocate_regions(static_cast<int>(part.piece));
+
+    // Ask web seeds too, instead of waiting for the swarm to get to it
+    fetch_from_web_seeds(static_cast<int>(part.piece));
+
+    // Make the blocking piece, and the one after it, time critical.
+    // libtorrent then requests them from the peers that deliver fastest,
+    // and from more than one peer if they are slow to arrive.
+    lt::piece_index_t next(static_cast<int>(part.piece) + 1);
+    bool has_next = static_cast<int>(next) < ti->num_pieces()
+        && !m_th.have_piece(next);
+
+    m_th.set_piece_deadline(part.piece, 0);
+    if (has_next) {
+        int64_t ms
+            = m_session->peer_scores().expected_ms(ti->piece_length());
+        m_th.set_piece_deadline(next, (int) std::max(ms, (int64_t) 100));
+    }
+
     if (cb)
         cb(0.0);
 
     // Wait for download
-    while (!m_th.have_piece(part.piece)) {
-        auto r = f.wait_for(std::chrono::seconds(1));
-        if (r == std::future_status::ready)
-            // At this point, we know either download is done and we can return
-            // early, or there was error and get() will throw and exception.
-            return f.get();
+    try {
+        while (!m_th.have_piece(part.piece)) {
+            if (m_closing)
+                throw std::runtime_error("Download closing");
+
+            auto r = f.wait_for(std::chrono::seconds(1));
+            if (r == std::future_status::ready) {
+                // At this point, we know either download is done and we can
+                // return early, or there was error and get() will throw and
+                // exception.
+                f.get();
+                break;
+            }
+        }
+    } catch (...) {
+        // Reader gave up, so these are not that urgent anymore
+        m_th.reset_piece_deadline(part.piece);
+        if (has_next)
+            m_th.reset_piece_deadline(next);
+        throw;
     }
 
+    // The piece can only be read once all of it is in and verified. How
+    // long that takes after the first block shows what the piece size
+    // costs.
+    if (dlprom.first_block().count() >= 0)
+        m_stats.add(ReadStats::STAGE_FIRST_BLOCK, dlprom.first_block());
+
     if (cb)
         cb(100.0);
 }
 
+void
+Download::queue_regions(int piece)
+{
+    if (m_storage_mode != StorageMode::Region)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_region_queue_mtx);
+
+    // Called for every block requested, so most calls end here
+    if (!m_region_queued.insert(piece).second)
+        return;
+
+    m_region_queue.push_back(piece);
+
+    if (m_region_working)
+        return;
+
+    // The last worker is done with the queue and about to return
+    if (m_region_worker.valid())
+        m_region_worker.wait();
+
+    m_region_working = true;
+    m_region_worker
+        = std::async(std::launch::async, &Download::region_worker, this);
+}
+
+void
+Download::region_worker()
+{
+    std::unique_lock<std::mutex> lock(m_region_queue_mtx);
+
+    while (!m_region_queue.empty() && !m_closing) {
+        int piece = m_region_queue.front();
+        m_region_queue.pop_front();
+
+        lock.unlock();
+
+        bool done = false;
+        try {
+            done = allocate_regions(piece);
+        } catch (...) {
+        }
+
+        lock.lock();
+
+        // Queue it again with the next block
+        if (!done)
+            m_region_queued.erase(piece);
+    }
+
+    m_region_working = false;
+}
+
+bool
+Download::allocate_regions(int piece)
+{
+    if (m_storage_mode != StorageMode::Region)
+        return true;
+
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, piece));
+
+#ifdef __linux__
+    std::unique_lock<std::mutex> lock(m_region_mtx);
+
+    if (!m_region_pieces.insert(piece).second)
+        return true;
+
+    auto ti = m_th.torrent_file();
+
+    const lt::file_storage& fs = ti->files();
+
+    lt::piece_index_t p(piece);
+
+    std::string save_path;
+
+    for (auto& slice : fs.map_block(p, 0, ti->piece_size(p))) {
+        if (fs.pad_file_at(slice.file_index) || slice.size <= 0)
+            continue;
+
+        int file = static_cast<int>(slice.file_index);
+        int64_t file_size = fs.file_size(slice.file_index);
+        int64_t first = slice.offset / REGION_SIZE;
+        int64_t last = (slice.offset + slice.size - 1) / REGION_SIZE;
+
+        for (int64_t r = first; r <= last; r++) {
+            if (m_regions.count({ file, r }))
+                continue;
+
+            // Where the storage is now, as the torrent may have been moved
+            if (save_path.empty())
+                save_path
+                    = m_th.status(lt::torrent_handle::query_save_path).save_path;
+
+            // libtorrent may not have created the file yet. Create it the
+            // way libtorrent would, leaving the permissions to the umask.
+            std::string path = fs.file_path(slice.file_index, save_path);
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+            if (fd < 0) {
+                m_region_pieces.erase(piece);
+                return false;
+            }
+
+            int64_t off = r * REGION_SIZE;
+            int64_t len = std::min((int64_t) REGION_SIZE, file_size - off);
+
+            // Leave the size to libtorrent, just reserve the blocks. Not all
+            // file systems can do this, in which case it stays sparse.
+            fallocate(fd, FALLOC_FL_KEEP_SIZE, off, len);
+            close(fd);
+
+            m_regions.insert({ file, r });
+        }
+    }
+#endif
+
+    return true;
+}
+
+void
+Download::fetch_from_web_seeds(int piece)
+{
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, piece));
+
+    std::unique_lock<std::mutex> lock(m_web_seed_mtx);
+
+    if (!m_web_seeds_loaded) {
+        for (auto& ws : m_th.torrent_file()->web_seeds()) {
+            if (ws.type == lt::web_seed_entry::url_seed)
+                m_web_seeds.push_back(std::make_unique<WebSeed>(ws.url));
+        }
+
+        m_web_seeds_loaded = true;
+    }
+
+    if (m_web_seeds.empty())
+        return;
+
+    // Forget about fetches that are done
+    m_web_seed_fetches.remove_if([](std::future<void>& f) {
+        return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+
+    // Already being fetched, or enough fetches going on. libtorrent still
+    // gets the piece from the swarm.
+    if (m_web_seed_fetches.size() >= WEB_SEED_FETCHES
+        || !m_web_seed_pieces.insert(piece).second)
+        return;
+
+    m_web_seed_fetches.push_back(std::async(std::launch::async, [this, piece] {
+        try {
+            fetch_piece(piece);
+        } catch (...) {
+        }
+
+        std::unique_lock<std::mutex> lock(m_web_seed_mtx);
+        m_web_seed_pieces.erase(piece);
+    }));
+}
+
+void
+Download::fetch_piece(int piece)
+{
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, piece));
+
+    auto ti = m_th.torrent_file();
+
+    const lt::file_storage& fs = ti->files();
+
+    int size = ti->piece_size(piece);
+
+    auto buf = BufferPool::get().acquire((size_t) size);
+
+    // Request exactly the parts of each file that make up the piece. Web
+    // seeds are only changed before any fetch starts, so no lock needed.
+    int pos = 0;
+    for (auto& slice : fs.map_block(piece, 0, size)) {
+        char* p = buf.get() + pos;
+
+        pos += (int) slice.size;
+
+        // Padding isn't on the server
+        if (fs.pad_file_at(slice.file_index)) {
+            memset(p, 0, (size_t) slice.size);
+            continue;
+        }
+
+        std::string path = fs.file_path(slice.file_index);
+
+        bool ok = false;
+        for (auto& ws : m_web_seeds) {
+            ok = ws->fetch(ws->file_url(path, fs.num_files() == 1),
+                slice.offset, p, (size_t) slice.size);
+            if (ok)
+                break;
+        }
+
+        if (!ok)
+            return;
+    }
+
+    if (m_closing || m_th.have_piece(piece))
+        return;
+
+    // Copied by libtorrent, then hash checked like any other piece
+    m_th.add_piece(piece, buf.get());
+}
+
 ssize_t
 Download::read(lt::peer_request part, char* buf, size_t buflen)
 {
@@ -638,26 +1857,52 @@ Download::read(lt::peer_request part, char* buf, size_t buflen)
 
     download_metadata();
 
-    ReadPiecePromise rdprom(m_th.info_hash(), part.piece);
-    AlertSubscriber<ReadPiecePromise> sub(m_session, &rdprom);
-    vlc_interrupt_guard<ReadPiecePromise> intrguard(rdprom);
+    boost::shared_array<char> piece_buffer;
+    int piece_size;
 
-    auto f = rdprom.get_future();
+    if (!m_cache.get(static_cast<int>(part.piece), piece_buffer, piece_size)) {
+        ReadPiecePromise rdprom(m_th.info_hash(), part.piece);
+        AlertSubscriber<ReadPiecePromise> sub(m_session, &rdprom);
+        vlc_interrupt_guard<ReadPiecePromise> intrguard(rdprom);
 
-    // Trigger read
-    m_th.read_piece(part.piece);
+        auto f = rdprom.get_future();
 
-    // Wait for read to complete
-    boost::shared_array<char> piece_buffer;
-    int piece_size;
-    std::tie(piece_buffer, piece_size) = f.get();
+        auto t = std::chrono::steady_clock::now();
+
+        // Trigger read
+        m_th.read_piece(part.piece);
+
+        // Wait for read to complete. The alert is lost if the alert queue
+        // overflows, so ask again now and then.
+        while (f.wait_for(READ_PIECE_RETRY) != std::future_status::ready) {
+            if (m_closing)
+                throw std::runtime_error("Download closing");
+
+            m_th.read_piece(part.piece);
+        }
+
+        std::tie(piece_buffer, piece_size) = f.get();
+
+        m_stats.add(ReadStats::STAGE_DISK, elapsed(t));
+
+        if (m_timeline)
+            m_timeline->piece_span(m_th.info_hash(),
+                static_cast<int>(part.piece), "read_piece", t,
+                std::chrono::steady_clock::now());
+
+        m_cache.put(static_cast<int>(part.piece), piece_buffer, piece_size);
+    }
 
     int len = std::min({ piece_size - part.start, (int) buflen, part.length });
     if (len < 0)
         return -1;
 
+    auto t = std::chrono::steady_clock::now();
+
     // Copy from libtorrent buffer to VLC buffer
     memcpy(buf, piece_buffer.get() + part.start, (size_t) len);
 
+    m_stats.add(ReadStats::STAGE_COPY, elapsed(t));
+
     return (ssize_t) len;
 }
@@ -21,9 +21,15 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #define VLC_BITTORRENT_DOWNLOAD_H
 
 #include <atomic>
+#include <deque>
+#include <exception>
 #include <forward_list>
+#include <future>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <thread>
 
 #pragma GCC diagnostic push
@@ -35,32 +41,74 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #include <libtorrent/torrent_handle.hpp>
 #pragma GCC diagnostic pop
 
+#include "piececache.h"
 #include "session.h"
+#include "stats.h"
+#include "timeline.h"
+#include "webseed.h"
 
 namespace lt = libtorrent;
 
 using MetadataProgressCb = std::function<void(float)>;
 using DataProgressCb = std::function<void(float)>;
+using FileVisitor = std::function<void(const std::string&, uint64_t)>;
+using ReadCompletion = std::function<void(ssize_t, std::exception_ptr)>;
 
-class Download {
+/**
+ * How files are laid out on disk. Sparse leaves holes until data arrives,
+ * Allocate reserves whole files when the download is added and Region
+ * reserves each region of a file just before its first piece is downloaded.
+ */
+enum class StorageMode { Sparse, Allocate, Region };
+
+class Download : public Alert_Listener {
 
 public:
     Download(const Download&) = delete;
     Download&
     operator=(const Download&)
         = delete;
-    Download(std::mutex& mtx, lt::add_torrent_params& atp, bool k);
+    Download(std::shared_ptr<std::mutex> mtx, lt::add_torrent_params& atp,
+        bool k, StorageMode mode, bool selective);
     ~Download();
 
+    /**
+     * Get the download for this metadata. The storage mode and selective
+     * flag only have effect if the download isn't already running. If
+     * selective, only files opened with open_file() are downloaded, apart
+     * from what is read or prefetched.
+     */
+    static std::shared_ptr<Download>
+    get_download(char* metadata, size_t metadatalen, std::string save_path,
+        bool keep, StorageMode mode, bool selective);
+
     static std::shared_ptr<Download>
     get_download(
-        char* metadata, size_t metadatalen, std::string save_path, bool keep);
+        char* metadata, size_t metadatalen, std::string save_path, bool keep)
+    {
+        return get_download(metadata, metadatalen, save_path, keep,
+            StorageMode::Sparse, false);
+    }
+
+    /**
+     * Storage mode by name: "sparse", "allocate" or "region".
+     */
+    static StorageMode
+    get_storage_mode(const std::string& name);
 
     /**
      * Get a part of the data of this download. If the data is not
      * available, it will download it and wait for it to become available.
+     * The window is the number of bytes after the requested part that
+     * should be downloaded with high priority. While waiting, progress_cb
+     * is called from libtorrent's alert thread as blocks of the piece
+     * arrive.
      */
     ssize_t
+    read(int file, int64_t off, char* buf, size_t buflen, int64_t window,
+        DataProgressCb progress_cb);
+
+    ssize_t
     read(int file, int64_t off, char* buf, size_t buflen,
         DataProgressCb progress_cb);
 
@@ -70,12 +118,94 @@ public:
         return read(file, off, buf, buflen, nullptr);
     }
 
+    /**
+     * Like read(), but returns at once. No thread waits for the piece:
+     * completion is called from libtorrent's alert thread when the piece is
+     * read, or before returning if it's at hand, and must not block. Any
+     * number of reads can be in flight. Completion is called exactly once,
+     * also for cancelled reads, and the buffer must stay valid until then.
+     * Completion must not hold on to the download. Returns an id for
+     * cancel_read().
+     */
+    uint64_t
+    async_read(int file, int64_t off, char* buf, size_t buflen,
+        int64_t window, ReadCompletion completion);
+
+    /**
+     * Fail a read started with async_read(), unless it's already done.
+     * Other reads of the same piece carry on.
+     */
+    void
+    cancel_read(uint64_t id);
+
+    /**
+     * Complete async reads. Called from libtorrent's alert thread.
+     */
+    void
+    handle_alert(lt::alert* a) override;
+
+    /**
+     * Tell that a reader paused. Once every reader attached with open_file()
+     * has paused, switch to low activity mode: only the windows after the
+     * positions given by the readers are downloaded, everything else is left
+     * alone. Uploads are capped to upload_limit bytes per second, unless
+     * it's zero. Each call must be matched by a resume().
+     */
+    void
+    pause(int file, int64_t off, int64_t window, int upload_limit);
+
+    /**
+     * Tell that a reader is attached to a file. In selective mode, files
+     * are only downloaded while at least one reader is attached.
+     */
+    void
+    open_file(int file);
+
+    void
+    close_file(int file);
+
+    /**
+     * Tell that a reader paused with pause() carries on, which leaves low
+     * activity mode and restores the priorities that were in effect before.
+     */
+    void
+    resume();
+
+    /**
+     * Summary of read latencies, stalls and buffer allocations, one
+     * statistic per line.
+     */
+    std::string
+    get_stats();
+
+    /**
+     * Current payload download rate in bytes per second.
+     */
+    int64_t
+    get_download_rate();
+
+    int
+    get_num_peers();
+
+    /**
+     * True if all of the given part of a file is downloaded.
+     */
+    bool
+    is_local(int file, int64_t off, int64_t size);
+
     static std::vector<std::pair<std::string, uint64_t>>
     get_files(char* metadata, size_t metadatalen);
 
     std::vector<std::pair<std::string, uint64_t>>
     get_files();
 
+    /**
+     * Call visitor with the path and size of each file, in torrent order,
+     * without building a list of them first. Padding files are skipped.
+     */
+    static void
+    visit_files(char* metadata, size_t metadatalen, FileVisitor visitor);
+
     static std::shared_ptr<std::vector<char>>
     get_metadata(std::string url, std::string save_path, std::string cache_path,
         MetadataProgressCb progress_cb);
@@ -95,6 +225,22 @@ public:
         return get_metadata(nullptr);
     }
 
+    /**
+     * Ask for a part of the data of this download to be downloaded as soon
+     * as possible, without waiting for it.
+     */
+    void
+    prefetch(int file, int64_t off, int64_t size);
+
+    /**
+     * Prefetch small subtitle files in the same directory as the given file
+     * whose names start with its name stem, such as "Movie.en.srt" next to
+     * "Movie.mkv", so that the player finds them without waiting. Returns
+     * the number of files prefetched.
+     */
+    int
+    prefetch_sidecars(int file);
+
     std::pair<int, uint64_t>
     get_file(std::string path);
 
@@ -106,7 +252,8 @@ public:
 
 private:
     static std::shared_ptr<Download>
-    get_download(lt::add_torrent_params& atp, bool k);
+    get_download(lt::add_torrent_params& atp, bool k, StorageMode mode,
+        bool selective);
 
     void
     download_metadata(MetadataProgressCb cb);
@@ -129,16 +276,194 @@ private:
     ssize_t
     read(lt::peer_request part, char* buf, size_t buflen);
 
+    /**
+     * Start fetching a piece from the web seeds, if there are any, and
+     * hand it to libtorrent when done.
+     */
+    void
+    fetch_from_web_seeds(int piece);
+
+    void
+    fetch_piece(int piece);
+
+    /**
+     * Set the priorities for reading a part of a file, with the given
+     * read-ahead window after it.
+     */
+    void
+    prioritize_read(int file, int64_t off, int length, int64_t window);
+
+    struct AsyncRead;
+
+    /**
+     * Copy the part of the piece an async read wants, account for it like
+     * read() does and complete it. Reading the piece started at
+     * read_start, if known.
+     */
+    void
+    finish_read(AsyncRead& r, const char* piece_buffer, int piece_size,
+        std::chrono::steady_clock::time_point read_start);
+
+    /**
+     * Ask libtorrent for a piece with async reads waiting for it, unless
+     * already asked. Pass force to ask again anyway.
+     */
+    void
+    issue_read(int piece, bool force);
+
+    /**
+     * In region mode, reserve disk space for the regions of the files this
+     * piece is in, unless already done. Called before reads wait for the
+     * piece, and by the region worker. Returns false if it has to be tried
+     * again later.
+     */
+    bool
+    allocate_regions(int piece);
+
+    /**
+     * In region mode, have the region worker allocate regions for a piece,
+     * without waiting for it. Called as blocks of the piece are requested.
+     */
+    void
+    queue_regions(int piece);
+
+    void
+    region_worker();
+
+    /**
+     * Download files with readers attached, and nothing else, keeping the
+     * pieces raised above normal priority in keep. Called with m_file_mtx
+     * held.
+     */
+    void
+    apply_file_priorities(const std::vector<lt::download_priority_t>& keep);
+
+    /**
+     * Enter or leave low activity mode, depending on how many readers are
+     * paused. Called with m_pause_mtx held.
+     */
+    void
+    update_pause();
+
     void
     set_piece_priority(int file, int64_t off, int size, libtorrent::download_priority_t prio);
 
-    // Locks mutex passed to constructor
+    // Shared with the registry entry, so it outlives both
+    std::shared_ptr<std::mutex> m_lock_mtx;
+
+    // Locks mutex passed to constructor, which keeps a new download of the
+    // same torrent from starting until this one is removed
     std::unique_lock<std::mutex> m_lock;
 
     bool m_keep;
 
+    // Low activity mode state
+    std::mutex m_pause_mtx;
+
+    std::atomic<bool> m_paused;
+
+    std::vector<lt::download_priority_t> m_paused_priorities;
+
+    int m_paused_upload_limit;
+
+    // Set if pausing capped uploads, so m_paused_upload_limit is to be put
+    // back
+    bool m_upload_capped;
+
+    // Readers paused, the windows they want filled and the latest upload
+    // limit asked for
+    int m_pause_count;
+
+    std::vector<lt::peer_request> m_pause_windows;
+
+    int m_pause_upload_limit;
+
+    // Readers attached with open_file()
+    std::atomic<int> m_readers;
+
+    // Web seed state
+    std::mutex m_web_seed_mtx;
+
+    bool m_web_seeds_loaded;
+
+    std::vector<std::unique_ptr<WebSeed>> m_web_seeds;
+
+    // Pieces being fetched from web seeds
+    std::set<int> m_web_seed_pieces;
+
+    std::list<std::future<void>> m_web_seed_fetches;
+
+    // Async read state
+    struct AsyncRead {
+        uint64_t id;
+        lt::peer_request part;
+        char* buf;
+        size_t buflen;
+        ReadCompletion completion;
+        // When asked for, and when found missing if it had to download
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point missed;
+    };
+
+    std::mutex m_read_mtx;
+
+    // Reads waiting for each piece
+    std::multimap<int, AsyncRead> m_reads;
+
+    // Pieces asked for with read_piece(), and when
+    std::map<int, std::chrono::steady_clock::time_point> m_reading;
+
+    uint64_t m_read_id;
+
+    // Makes waits for pieces give up, set when destroyed
+    std::atomic<bool> m_closing;
+
+    // Selective mode state
+    bool m_selective;
+
+    std::mutex m_file_mtx;
+
+    // Number of readers attached to each file
+    std::map<int, int> m_file_refs;
+
+    // Set if files were opened or closed while paused
+    bool m_files_changed;
+
+    // Storage state
+    StorageMode m_storage_mode;
+
+    std::mutex m_region_mtx;
+
+    // File index and region number of regions already allocated
+    std::set<std::pair<int, int64_t>> m_regions;
+
+    // Pieces whose regions are allocated
+    std::set<int> m_region_pieces;
+
+    // Region worker state. Kept apart from m_region_mtx, which is held
+    // during disk I/O.
+    std::mutex m_region_queue_mtx;
+
+    std::deque<int> m_region_queue;
+
+    // Pieces queued, whether done or not
+    std::set<int> m_region_queued;
+
+    bool m_region_working;
+
+    std::future<void> m_region_worker;
+
+    ReadStats m_stats;
+
+    // Piece timeline, if enabled when the download was created
+    std::shared_ptr<Timeline> m_timeline;
+
     std::shared_ptr<Session> m_session;
 
+    // Charged to the session's memory budget, so declared after m_session
+    // to be destroyed before it
+    PieceCache m_cache;
+
     lt::torrent_handle m_th;
 };
 
@@ -119,6 +119,8 @@ MagnetMetadataOpen(vlc_object_t* p_this)
     try {
         msg_Info(p_access, "Reading metadata");
 
+        configure_session(p_this);
+
         auto del = [&](vlc_dialog_id* dialog) {
             vlc_dialog_release(p_this, dialog);
         };
@@ -0,0 +1,187 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <limits>
+
+#include "memory.h"
+
+#define D(x)
+
+MemoryBudget::MemoryBudget()
+    : m_limit(0)
+    , m_external(0)
+    , m_used(0)
+{
+}
+
+void
+MemoryBudget::set_limit(int64_t limit)
+{
+    D(printf("%s:%d: %s(%ld)\n", __FILE__, __LINE__, __func__, limit));
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    m_limit = std::max(limit, (int64_t) 0);
+
+    enforce();
+}
+
+int64_t
+MemoryBudget::get_limit()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    return m_limit;
+}
+
+void
+MemoryBudget::set_external(int64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    m_external = std::max(bytes, (int64_t) 0);
+
+    enforce();
+}
+
+void
+MemoryBudget::register_consumer(MemoryConsumer* c)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    m_consumers[c] = 0;
+}
+
+void
+MemoryBudget::unregister_consumer(MemoryConsumer* c)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    auto it = m_consumers.find(c);
+    if (it == m_consumers.end())
+        return;
+
+    m_used -= it->second;
+    m_consumers.erase(it);
+}
+
+void
+MemoryBudget::charge(MemoryConsumer* c, int64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    auto it = m_consumers.find(c);
+    if (it == m_consumers.end())
+        return;
+
+    it->second += bytes;
+    m_used += bytes;
+
+    enforce();
+}
+
+void
+MemoryBudget::release(MemoryConsumer* c, int64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    auto it = m_consumers.find(c);
+    if (it == m_consumers.end())
+        return;
+
+    bytes = std::min(bytes, it->second);
+
+    it->second -= bytes;
+    m_used -= bytes;
+}
+
+int64_t
+MemoryBudget::fair_share()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    if (m_limit == 0)
+        return std::numeric_limits<int64_t>::max();
+
+    int64_t available = std::max(m_limit - m_external, (int64_t) 0);
+
+    return available / std::max((int64_t) m_consumers.size(), (int64_t) 1);
+}
+
+int64_t
+MemoryBudget::get_used()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    return m_used + m_external;
+}
+
+// Called with m_mtx held
+void
+MemoryBudget::enforce()
+{
+    if (m_limit == 0)
+        return;
+
+    int64_t available = std::max(m_limit - m_external, (int64_t) 0);
+    int64_t share
+        = available / std::max((int64_t) m_consumers.size(), (int64_t) 1);
+
+    while (m_used > available) {
+        // Coldest buffer of consumers over their share, else of anyone
+        MemoryConsumer* victim = nullptr;
+        bool victim_over = false;
+        auto victim_time = std::chrono::steady_clock::time_point::max();
+
+        for (auto& c : m_consumers) {
+            if (c.second <= 0)
+                continue;
+
+            bool over = c.second > share;
+            auto t = c.first->coldest();
+
+            if ((over && !victim_over) || (over == victim_over && t < victim_time)) {
+                victim = c.first;
+                victim_over = over;
+                victim_time = t;
+            }
+        }
+
+        if (!victim)
+            break;
+
+        int64_t freed = victim->evict();
+        if (freed <= 0)
+            break;
+
+        auto& held = m_consumers[victim];
+        freed = std::min(freed, held);
+        held -= freed;
+        m_used -= freed;
+    }
+}
@@ -0,0 +1,121 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_MEMORY_H
+#define VLC_BITTORRENT_MEMORY_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+/**
+ * Something holding buffers that can be given back on request.
+ */
+struct MemoryConsumer {
+    virtual ~MemoryConsumer() { }
+
+    /**
+     * Time of last use of the least recently used buffer, or max() if
+     * nothing is held.
+     */
+    virtual std::chrono::steady_clock::time_point
+    coldest()
+        = 0;
+
+    /**
+     * Free the least recently used buffer. Returns number of bytes freed.
+     * Must not call back into MemoryBudget.
+     */
+    virtual int64_t
+    evict()
+        = 0;
+};
+
+/**
+ * Keeps the memory held by all consumers in the process below a limit.
+ * When over the limit, buffers are evicted coldest first, starting with
+ * consumers holding more than their fair share.
+ */
+class MemoryBudget {
+public:
+    MemoryBudget();
+
+    /**
+     * Limit in bytes, zero means unlimited.
+     */
+    void
+    set_limit(int64_t limit);
+
+    int64_t
+    get_limit();
+
+    /**
+     * Memory held by libtorrent, which counts towards the limit but can't
+     * be evicted.
+     */
+    void
+    set_external(int64_t bytes);
+
+    void
+    register_consumer(MemoryConsumer* c);
+
+    /**
+     * Forget about a consumer. Anything still charged to it is released.
+     */
+    void
+    unregister_consumer(MemoryConsumer* c);
+
+    /**
+     * Account for bytes now held by a consumer, and evict if this takes the
+     * total above the limit. The consumer must not hold any of its own locks
+     * when calling this.
+     */
+    void
+    charge(MemoryConsumer* c, int64_t bytes);
+
+    void
+    release(MemoryConsumer* c, int64_t bytes);
+
+    /**
+     * Bytes each consumer may hold without being first in line for eviction.
+     * Returns max() if unlimited.
+     */
+    int64_t
+    fair_share();
+
+    int64_t
+    get_used();
+
+private:
+    void
+    enforce();
+
+    std::mutex m_mtx;
+
+    int64_t m_limit;
+
+    int64_t m_external;
+
+    int64_t m_used;
+
+    std::map<MemoryConsumer*, int64_t> m_consumers;
+};
+
+#endif
@@ -21,48 +21,121 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #include "config.h"
 #endif
 
+#include <algorithm>
+#include <cctype>
 #include <memory>
+#include <set>
+#include <sstream>
+#include <string>
 #include <vector>
 
+#include "bufferpool.h"
 #include "download.h"
 #include "metadata.h"
 #include "vlc.h"
 
 #define D(x)
 
+static std::set<std::string>
+parse_extensions(const std::string& list)
+{
+    std::set<std::string> exts;
+
+    // List is on the form "*.avi;*.mkv;..."
+    std::istringstream is(list);
+    for (std::string ext; std::getline(is, ext, ';');) {
+        if (ext.compare(0, 2, "*.") == 0)
+            ext = ext.substr(2);
+
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+            [](unsigned char c) { return (char) std::tolower(c); });
+
+        if (!ext.empty())
+            exts.insert(ext);
+    }
+
+    return exts;
+}
+
+static bool
+is_playable(const std::string& path)
+{
+    static const std::set<std::string> exts
+        = parse_extensions(EXTENSIONS_MEDIA ";" EXTENSIONS_SUBTITLE);
+
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+        return false;
+
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+        [](unsigned char c) { return (char) std::tolower(c); });
+
+    return exts.count(ext) > 0;
+}
+
 static int
 MetadataReadDir(stream_directory_t* p_directory, input_item_node_t* p_node)
 {
     D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
 
     // Temporary buffer to hold metadata
-    auto md = std::make_unique<char[]>(0x100000);
+    auto md = BufferPool::get().acquire(0x100000);
 
     ssize_t mdsz = vlc_stream_Read(p_directory->source, md.get(), 0x100000);
     if (mdsz < 0)
         return VLC_EGENERIC;
 
-    std::vector<std::pair<std::string, uint64_t>> files;
-    try {
-        files = Download::get_files(md.get(), (size_t) mdsz);
-    } catch (std::runtime_error& e) {
-        msg_Err(p_directory, "Failed to parse metadata: %s", e.what());
-        return VLC_EGENERIC;
-    }
-
     struct vlc_readdir_helper rdh;
     vlc_readdir_helper_init(&rdh, p_directory, p_node);
 
-    for (auto f : files) {
+    // Directory nodes are made by the helper as items below them are
+    // added, so directories without anything listed never get one
+    auto add = [&](const std::string& path) {
         std::unique_ptr<char, decltype(&free)> mrl(
-            vlc_stream_extractor_CreateMRL(p_directory, f.first.c_str()), free);
+            vlc_stream_extractor_CreateMRL(p_directory, path.c_str()), free);
         if (!mrl)
-            continue;
+            return;
 
         int ret = vlc_readdir_helper_additem(
-            &rdh, mrl.get(), f.first.c_str(), NULL, ITEM_TYPE_FILE, ITEM_LOCAL);
+            &rdh, mrl.get(), path.c_str(), NULL, ITEM_TYPE_FILE, ITEM_LOCAL);
         if (ret != VLC_SUCCESS)
             msg_Warn(p_directory, "Failed to add %s", mrl.get());
+    };
+
+    // Larger torrents only get their media and subtitle files listed
+    uint64_t max_listed
+        = (uint64_t) get_max_listed_files(VLC_OBJECT(p_directory));
+
+    uint64_t total = 0;
+
+    // Other files, listed after media and subtitles while there are few
+    // enough files
+    std::vector<std::string> rest;
+
+    try {
+        Download::visit_files(md.get(), (size_t) mdsz,
+            [&](const std::string& path, uint64_t) {
+                total++;
+
+                if (is_playable(path))
+                    add(path);
+                else if (max_listed == 0 || total <= max_listed)
+                    rest.push_back(path);
+            });
+
+        if (max_listed == 0 || total <= max_listed) {
+            for (auto& path : rest)
+                add(path);
+        } else {
+            msg_Warn(p_directory, "Only listing media and subtitle files of "
+                "%" PRIu64 " files, set " MAX_LISTED_CONFIG " to list all",
+                total);
+        }
+    } catch (std::runtime_error& e) {
+        msg_Err(p_directory, "Failed to parse metadata: %s", e.what());
+        vlc_readdir_helper_finish(&rdh, false);
+        return VLC_EGENERIC;
     }
 
     vlc_readdir_helper_finish(&rdh, true);
@@ -89,6 +162,9 @@ MetadataOpen(vlc_object_t* p_obj)
     if (len < 1 || data[0] != 'd')
         return VLC_EGENERIC;
 
+    // Whatever gets played next needs the session
+    prewarm_session(p_obj);
+
     p_directory->pf_readdir = MetadataReadDir;
 
     return VLC_SUCCESS;
@@ -0,0 +1,322 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/session_stats.hpp>
+#pragma GCC diagnostic pop
+
+#include "metrics.h"
+
+#define D(x)
+
+// How long to wait for a scraper to send its request
+#define REQUEST_TIMEOUT_MS 1000
+
+namespace lt = libtorrent;
+
+/**
+ * Transfer rates derived from counters, in units per second.
+ */
+static const struct {
+    const char* name;
+    const char* counter;
+    const char* help;
+} rates[] = {
+    { "download_payload_bytes", "net.recv_payload_bytes",
+        "Payload downloaded" },
+    { "upload_payload_bytes", "net.sent_payload_bytes", "Payload uploaded" },
+    { "redundant_bytes", "net.recv_redundant_bytes",
+        "Data downloaded more than once" },
+    { "hash_failed_bytes", "net.recv_failed_bytes",
+        "Data that failed the hash check" },
+    { "disk_blocks_written", "disk.num_blocks_written",
+        "Blocks written to disk" },
+    { "disk_blocks_read", "disk.num_blocks_read", "Blocks read from disk" },
+};
+
+static std::string
+metric_name(const char* name)
+{
+    std::string result = std::string("libtorrent_") + name;
+    std::replace(result.begin(), result.end(), '.', '_');
+    return result;
+}
+
+Metrics::Metrics()
+    : m_next(0)
+    , m_fd(-1)
+    , m_server_quit(false)
+{
+}
+
+Metrics::~Metrics()
+{
+    stop_server();
+}
+
+void
+Metrics::add(std::vector<int64_t> counters)
+{
+    std::string path;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        Sample s = { std::chrono::steady_clock::now(), std::move(counters) };
+
+        if (m_samples.size() < METRICS_SAMPLES)
+            m_samples.push_back(std::move(s));
+        else
+            m_samples[m_next] = std::move(s);
+
+        m_next = (m_next + 1) % METRICS_SAMPLES;
+
+        path = m_path;
+    }
+
+    if (!path.empty() && path.compare(0, strlen(METRICS_UNIX_PREFIX),
+                             METRICS_UNIX_PREFIX) != 0)
+        write_file(path, format());
+}
+
+std::string
+Metrics::format()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    if (m_samples.empty())
+        return std::string();
+
+    size_t n = m_samples.size();
+    const Sample& latest = m_samples[(m_next + n - 1) % n];
+    const Sample& oldest = m_samples[n < METRICS_SAMPLES ? 0 : m_next];
+
+    std::ostringstream os;
+
+    for (auto& m : lt::session_stats_metrics()) {
+        if (m.value_index < 0
+            || (size_t) m.value_index >= latest.counters.size())
+            continue;
+
+        std::string name = metric_name(m.name);
+
+        if (m.type == lt::metric_type_t::counter) {
+            name += "_total";
+            os << "# TYPE " << name << " counter\n";
+        } else {
+            os << "# TYPE " << name << " gauge\n";
+        }
+
+        os << name << " " << latest.counters[(size_t) m.value_index] << "\n";
+    }
+
+    double seconds = std::chrono::duration<double>(latest.time - oldest.time)
+                         .count();
+
+    for (auto& r : rates) {
+        int idx = lt::find_metric_idx(r.counter);
+        if (idx < 0 || (size_t) idx >= latest.counters.size())
+            continue;
+
+        int64_t delta = latest.counters[(size_t) idx]
+            - oldest.counters[(size_t) idx];
+
+        std::string name
+            = std::string("vlc_bittorrent_") + r.name + "_per_second";
+
+        os << "# HELP " << name << " " << r.help << ", averaged over "
+           << (int) seconds << " seconds\n";
+        os << "# TYPE " << name << " gauge\n";
+        os << name << " " << (seconds > 0 ? (double) delta / seconds : 0)
+           << "\n";
+    }
+
+    return os.str();
+}
+
+void
+Metrics::write_file(const std::string& path, const std::string& text)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    // Scrapers never see a half written file
+    std::string tmp = path + ".tmp";
+
+    {
+        std::ofstream os(tmp, std::ios::trunc);
+        os << text;
+        if (!os)
+            return;
+    }
+
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        // Windows doesn't replace existing files
+        std::remove(path.c_str());
+        std::rename(tmp.c_str(), path.c_str());
+    }
+}
+
+void
+Metrics::export_to(const std::string& path)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    stop_server();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_path = path;
+    }
+
+    if (path.compare(0, strlen(METRICS_UNIX_PREFIX), METRICS_UNIX_PREFIX)
+        != 0)
+        return;
+
+#ifdef __linux__
+    std::string socket_path = path.substr(strlen(METRICS_UNIX_PREFIX));
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Bad metrics socket path");
+
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error("Failed to create metrics socket");
+
+    // Another daemon or exporter is already serving this socket
+    if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+        close(fd);
+        throw std::runtime_error(
+            "Metrics socket " + socket_path + " already in use");
+    }
+
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error("Failed to create metrics socket");
+
+    // Left behind by a previous run
+    unlink(socket_path.c_str());
+
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+        || listen(fd, 4) < 0) {
+        close(fd);
+        throw std::runtime_error(
+            "Failed to listen on " + socket_path + ": " + strerror(errno));
+    }
+
+    m_fd = fd;
+    m_server_quit = false;
+    m_server = std::thread(&Metrics::serve, this);
+#else
+    throw std::runtime_error("Metrics sockets not supported");
+#endif
+}
+
+std::string
+Metrics::get_export_path()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    return m_path;
+}
+
+void
+Metrics::serve()
+{
+#ifdef __linux__
+    while (!m_server_quit) {
+        struct pollfd pfd = { m_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+
+        int client = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0)
+            continue;
+
+        // Answer like an HTTP server, so curl --unix-socket and proxies in
+        // front of Prometheus work. Whatever the request was.
+        struct pollfd cfd = { client, POLLIN, 0 };
+        if (poll(&cfd, 1, REQUEST_TIMEOUT_MS) > 0) {
+            char buf[4096];
+            (void) recv(client, buf, sizeof(buf), MSG_DONTWAIT);
+        }
+
+        std::string text = format();
+        std::string reply = "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: "
+            + std::to_string(text.size()) + "\r\n\r\n" + text;
+
+        size_t sent = 0;
+        while (sent < reply.size()) {
+            ssize_t n = send(client, reply.data() + sent, reply.size() - sent,
+                MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            sent += (size_t) n;
+        }
+
+        close(client);
+    }
+#endif
+}
+
+void
+Metrics::stop_server()
+{
+    if (!m_server.joinable())
+        return;
+
+    m_server_quit = true;
+    m_server.join();
+
+#ifdef __linux__
+    close(m_fd);
+#endif
+    m_fd = -1;
+}
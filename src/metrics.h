@@ -0,0 +1,110 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef VLC_BITTORRENT_METRICS_H
+#define VLC_BITTORRENT_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Samples kept for rates, five minutes at the session's sampling interval
+#define METRICS_SAMPLES 60
+
+// Prefix of export paths that name a Unix socket rather than a file
+#define METRICS_UNIX_PREFIX "unix:"
+
+/**
+ * Recent samples of libtorrent's session counters, exported in the
+ * Prometheus text format. Every counter and gauge is exported as is, along
+ * with transfer rates averaged over the samples kept.
+ */
+class Metrics {
+public:
+    Metrics(const Metrics&) = delete;
+    Metrics&
+    operator=(const Metrics&)
+        = delete;
+    Metrics();
+    ~Metrics();
+
+    /**
+     * Add a sample of all session counters, indexed like
+     * lt::session_stats_metrics(). Rewrites the export file, if any.
+     */
+    void
+    add(std::vector<int64_t> counters);
+
+    /**
+     * Latest sample and rates in the Prometheus text format. Empty until
+     * the first sample.
+     */
+    std::string
+    format();
+
+    /**
+     * Where to export to: a file, replaced after every sample, or a Unix
+     * socket given as "unix:PATH", where each connection gets the latest
+     * sample. Empty stops exporting. Throws if the socket can't be set up.
+     */
+    void
+    export_to(const std::string& path);
+
+    std::string
+    get_export_path();
+
+private:
+    struct Sample {
+        std::chrono::steady_clock::time_point time;
+
+        std::vector<int64_t> counters;
+    };
+
+    void
+    write_file(const std::string& path, const std::string& text);
+
+    void
+    serve();
+
+    void
+    stop_server();
+
+    std::mutex m_mtx;
+
+    // Ring buffer of samples, m_next is where the next one goes
+    std::vector<Sample> m_samples;
+
+    size_t m_next;
+
+    std::string m_path;
+
+    // Listening socket when exporting to a Unix socket
+    int m_fd;
+
+    std::thread m_server;
+
+    std::atomic<bool> m_server_quit;
+};
+
+#endif
@@ -28,6 +28,16 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #include "metadata.h"
 #include "vlc.h"
 
+static const char* const profile_values[]
+    = { "low-latency", "high-throughput", "low-memory", "seedbox" };
+static const char* const profile_texts[]
+    = { "Low latency", "High throughput", "Low memory", "Seedbox" };
+
+static const char* const storage_mode_values[]
+    = { "sparse", "allocate", "region" };
+static const char* const storage_mode_texts[]
+    = { "Sparse", "Allocate on open", "Allocate on first write per region" };
+
 // clang-format off
 
 vlc_module_begin()
@@ -43,11 +53,122 @@ vlc_module_begin()
         "Directory where VLC will put downloaded files.", false)
     add_bool(KEEP_CONFIG, false, "Don't delete files",
         "Don't delete files after download.", true)
+    add_integer(PAUSE_UPLOAD_CONFIG, 0, "Upload limit when paused (kB/s)",
+        "Limit uploads to this rate while playback is paused. "
+        "0 means no limit.", true)
+    add_savefile(STATS_CONFIG, NULL, "Statistics file",
+        "Append read latency statistics of a torrent to this file when the "
+        "last stream playing from it is closed.", true)
+    add_savefile(TRACE_CONFIG, NULL, "Trace file",
+        "Append the position, size and latency of every read to this file, "
+        "for replaying with tracereplay.", true)
+    add_string(METRICS_CONFIG, NULL, "Metrics export",
+        "Write libtorrent session counters in the Prometheus text format to "
+        "this file every few seconds, or serve them on a Unix socket given "
+        "as unix:PATH.", true)
+    add_savefile(TIMELINE_CONFIG, NULL, "Piece timeline file",
+        "Write when each piece was prioritized, downloaded, hash checked, "
+        "read and served to this file, for chrome://tracing or Perfetto.", true)
+    add_string(PROFILE_CONFIG, "low-latency", "Tuning profile",
+        "Set of libtorrent settings to start from.", true)
+        change_string_list(profile_values, profile_texts)
+    add_integer(CONNECTIONS_CONFIG, 0, "Connection limit",
+        "Maximum number of peer connections. 0 means use the profile's.",
+        true)
+    add_integer(DISK_QUEUE_CONFIG, 0, "Disk queue size (kB)",
+        "Maximum bytes waiting to be written to disk. "
+        "0 means use the profile's.", true)
+    add_integer(AIO_THREADS_CONFIG, 0, "Disk I/O threads",
+        "Number of disk I/O threads. 0 means use the profile's.", true)
+    add_integer(HASHING_THREADS_CONFIG, 0, "Hashing threads",
+        "Number of piece hashing threads. 0 means use the profile's.", true)
+    add_integer(SEND_BUFFER_CONFIG, 0, "Socket send buffer (kB)",
+        "Socket send buffer size. 0 means use the profile's.", true)
+    add_integer(RECV_BUFFER_CONFIG, 0, "Socket receive buffer (kB)",
+        "Socket receive buffer size. 0 means use the profile's.", true)
+    add_integer(DOWNLOAD_RATE_CONFIG, 0, "Download rate limit (kB/s)",
+        "Limit download rate. 0 means no limit.", true)
+    add_integer(UPLOAD_RATE_CONFIG, 0, "Upload rate limit (kB/s)",
+        "Limit upload rate. 0 means no limit.", true)
+    add_integer(MEMORY_CONFIG, 0, "Memory limit (MB)",
+        "Limit memory used for buffers across all torrents, including "
+        "libtorrent's disk queues. 0 means no limit.", true)
+    add_string(DAEMON_CONFIG, NULL, "Daemon socket",
+        "Attach to a vlc-bittorrentd listening on this Unix socket, so that "
+        "VLC instances on this host share downloads. Empty means download "
+        "in-process.", true)
+    add_string(STORAGE_MODE_CONFIG, "sparse", "Storage mode",
+        "How downloaded files are allocated on disk.", true)
+        change_string_list(storage_mode_values, storage_mode_texts)
+    add_bool(SELECTIVE_CONFIG, true, "Only download files being played",
+        "Leave the other files of a multi-file torrent alone until they are "
+        "opened.", true)
+    add_bool(PREWARM_CONFIG, false, "Pre-warm session",
+        "Start the Bittorrent session while a torrent file is being parsed, "
+        "and keep it for a minute, so playback doesn't wait for it.", true)
+    add_integer(MAX_LISTED_CONFIG, 10000, "Most files listed",
+        "In torrents with more files than this, only list media and "
+        "subtitle files. 0 means list all files.", true)
 #else
     add_directory(DLDIR_CONFIG, NULL, "Downloads",
         "Directory where VLC will put downloaded files.")
     add_bool(KEEP_CONFIG, false, "Don't delete files",
         "Don't delete files after download.")
+    add_integer(PAUSE_UPLOAD_CONFIG, 0, "Upload limit when paused (kB/s)",
+        "Limit uploads to this rate while playback is paused. "
+        "0 means no limit.")
+    add_savefile(STATS_CONFIG, NULL, "Statistics file",
+        "Append read latency statistics of a torrent to this file when the "
+        "last stream playing from it is closed.")
+    add_savefile(TRACE_CONFIG, NULL, "Trace file",
+        "Append the position, size and latency of every read to this file, "
+        "for replaying with tracereplay.")
+    add_string(METRICS_CONFIG, NULL, "Metrics export",
+        "Write libtorrent session counters in the Prometheus text format to "
+        "this file every few seconds, or serve them on a Unix socket given "
+        "as unix:PATH.")
+    add_savefile(TIMELINE_CONFIG, NULL, "Piece timeline file",
+        "Write when each piece was prioritized, downloaded, hash checked, "
+        "read and served to this file, for chrome://tracing or Perfetto.")
+    add_string(PROFILE_CONFIG, "low-latency", "Tuning profile",
+        "Set of libtorrent settings to start from.")
+        change_string_list(profile_values, profile_texts)
+    add_integer(CONNECTIONS_CONFIG, 0, "Connection limit",
+        "Maximum number of peer connections. 0 means use the profile's.")
+    add_integer(DISK_QUEUE_CONFIG, 0, "Disk queue size (kB)",
+        "Maximum bytes waiting to be written to disk. "
+        "0 means use the profile's.")
+    add_integer(AIO_THREADS_CONFIG, 0, "Disk I/O threads",
+        "Number of disk I/O threads. 0 means use the profile's.")
+    add_integer(HASHING_THREADS_CONFIG, 0, "Hashing threads",
+        "Number of piece hashing threads. 0 means use the profile's.")
+    add_integer(SEND_BUFFER_CONFIG, 0, "Socket send buffer (kB)",
+        "Socket send buffer size. 0 means use the profile's.")
+    add_integer(RECV_BUFFER_CONFIG, 0, "Socket receive buffer (kB)",
+        "Socket receive buffer size. 0 means use the profile's.")
+    add_integer(DOWNLOAD_RATE_CONFIG, 0, "Download rate limit (kB/s)",
+        "Limit download rate. 0 means no limit.")
+    add_integer(UPLOAD_RATE_CONFIG, 0, "Upload rate limit (kB/s)",
+        "Limit upload rate. 0 means no limit.")
+    add_integer(MEMORY_CONFIG, 0, "Memory limit (MB)",
+        "Limit memory used for buffers across all torrents, including "
+        "libtorrent's disk queues. 0 means no limit.")
+    add_string(DAEMON_CONFIG, NULL, "Daemon socket",
+        "Attach to a vlc-bittorrentd listening on this Unix socket, so that "
+        "VLC instances on this host share downloads. Empty means download "
+        "in-process.")
+    add_string(STORAGE_MODE_CONFIG, "sparse", "Storage mode",
+        "How downloaded files are allocated on disk.")
+        change_string_list(storage_mode_values, storage_mode_texts)
+    add_bool(SELECTIVE_CONFIG, true, "Only download files being played",
+        "Leave the other files of a multi-file torrent alone until they are "
+        "opened.")
+    add_bool(PREWARM_CONFIG, false, "Pre-warm session",
+        "Start the Bittorrent session while a torrent file is being parsed, "
+        "and keep it for a minute, so playback doesn't wait for it.")
+    add_integer(MAX_LISTED_CONFIG, 10000, "Most files listed",
+        "In torrents with more files than this, only list media and "
+        "subtitle files. 0 means list all files.")
 #endif
 
     add_submodule()
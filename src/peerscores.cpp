@@ -0,0 +1,182 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/alert_types.hpp>
+#pragma GCC diagnostic pop
+
+#include "peerscores.h"
+
+#define D(x)
+
+// Size of a bittorrent block
+#define BLOCK_SIZE (16 * 1024)
+
+// Peers silent for this long are forgotten
+#define PEER_TIMEOUT std::chrono::seconds(60)
+
+// More pending requests than this per peer means some were lost
+#define MAX_PENDING 256
+
+// Peers listed in stats
+#define STATS_PEERS 5
+
+PeerScores::PeerScores()
+    : m_pruned(clock_type::now())
+{
+}
+
+void
+PeerScores::handle_alert(lt::alert* a)
+{
+    if (auto* x = lt::alert_cast<lt::block_downloading_alert>(a)) {
+        auto now = clock_type::now();
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        auto& p = m_peers[x->endpoint];
+        if (p.pending.size() >= MAX_PENDING)
+            p.pending.clear();
+
+        p.pending[std::make_pair(
+            static_cast<int>(x->piece_index), x->block_index)]
+            = now;
+
+        if (p.first == clock_type::time_point())
+            p.first = now;
+        p.last = now;
+    } else if (auto* x = lt::alert_cast<lt::block_finished_alert>(a)) {
+        auto now = clock_type::now();
+
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        auto it = m_peers.find(x->endpoint);
+        if (it == m_peers.end())
+            return;
+
+        auto& p = it->second;
+
+        auto req = p.pending.find(std::make_pair(
+            static_cast<int>(x->piece_index), x->block_index));
+        if (req != p.pending.end()) {
+            int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                now - req->second).count();
+
+            // Smooth over the last few blocks
+            p.latency_us = p.latency_us ? (3 * p.latency_us + us) / 4 : us;
+
+            p.pending.erase(req);
+        }
+
+        p.bytes += BLOCK_SIZE;
+        p.last = now;
+
+        if (now - m_pruned > PEER_TIMEOUT)
+            prune(now);
+    }
+}
+
+int64_t
+PeerScores::expected_ms(int64_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    int64_t best = 0;
+    int64_t latency_us = 0;
+
+    for (auto& p : m_peers) {
+        int64_t r = rate(p.second);
+        if (r > best) {
+            best = r;
+            latency_us = p.second.latency_us;
+        }
+    }
+
+    if (best == 0)
+        return -1;
+
+    return latency_us / 1000 + size * 1000 / best;
+}
+
+std::string
+PeerScores::get_stats()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    std::vector<std::pair<int64_t, const lt::tcp::endpoint*>> ranked;
+    for (auto& p : m_peers)
+        ranked.emplace_back(rate(p.second), &p.first);
+
+    std::sort(ranked.begin(), ranked.end(),
+        [](const std::pair<int64_t, const lt::tcp::endpoint*>& a,
+            const std::pair<int64_t, const lt::tcp::endpoint*>& b) {
+            return a.first > b.first;
+        });
+
+    std::ostringstream os;
+
+    os << "peers: " << m_peers.size() << " scored\n";
+
+    for (size_t i = 0; i < ranked.size() && i < STATS_PEERS; i++) {
+        auto& p = m_peers[*ranked[i].second];
+
+        os << "peer " << *ranked[i].second << ": latency " << p.latency_us
+           << " us, " << ranked[i].first << " bytes/s\n";
+    }
+
+    return os.str();
+}
+
+// static
+int64_t
+PeerScores::rate(const Peer& p)
+{
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+        p.last - p.first).count();
+
+    // Need at least a second worth of samples
+    if (us < 1000000)
+        return 0;
+
+    return p.bytes * 1000000 / us;
+}
+
+// Called with m_mtx held
+void
+PeerScores::prune(clock_type::time_point now)
+{
+    for (auto it = m_peers.begin(); it != m_peers.end();) {
+        if (now - it->second.last > PEER_TIMEOUT)
+            it = m_peers.erase(it);
+        else
+            ++it;
+    }
+
+    m_pruned = now;
+}
@@ -0,0 +1,95 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_PEERSCORES_H
+#define VLC_BITTORRENT_PEERSCORES_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/alert.hpp>
+#include <libtorrent/socket.hpp>
+#pragma GCC diagnostic pop
+
+namespace lt = libtorrent;
+
+/**
+ * Block request latency and delivered throughput of each peer, worked out
+ * from block progress alerts.
+ */
+class PeerScores {
+public:
+    PeerScores();
+
+    void
+    handle_alert(lt::alert* a);
+
+    /**
+     * Expected time in milliseconds for the best peer to deliver size
+     * bytes, or -1 if nothing is known yet.
+     */
+    int64_t
+    expected_ms(int64_t size);
+
+    /**
+     * Best peers, one per line.
+     */
+    std::string
+    get_stats();
+
+private:
+    using clock_type = std::chrono::steady_clock;
+
+    struct Peer {
+        // Requested blocks by piece and block index
+        std::map<std::pair<int, int>, clock_type::time_point> pending;
+
+        // Smoothed time from request to block received
+        int64_t latency_us = 0;
+
+        int64_t bytes = 0;
+
+        clock_type::time_point first;
+
+        clock_type::time_point last;
+    };
+
+    // Bytes per second delivered, or zero if too little is known
+    static int64_t
+    rate(const Peer& p);
+
+    // Forget peers we haven't heard from in a while
+    void
+    prune(clock_type::time_point now);
+
+    std::mutex m_mtx;
+
+    std::map<lt::tcp::endpoint, Peer> m_peers;
+
+    clock_type::time_point m_pruned;
+};
+
+#endif
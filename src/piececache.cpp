@@ -0,0 +1,152 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+
+#include "piececache.h"
+
+#define D(x)
+
+PieceCache::PieceCache(MemoryBudget& budget, int64_t capacity)
+    : m_budget(budget)
+    , m_capacity(capacity)
+    , m_held(0)
+{
+    m_budget.register_consumer(this);
+}
+
+PieceCache::~PieceCache()
+{
+    m_budget.unregister_consumer(this);
+}
+
+bool
+PieceCache::get(int piece, boost::shared_array<char>& buffer, int& size)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    auto it = m_pieces.find(piece);
+    if (it == m_pieces.end())
+        return false;
+
+    // Move to front
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+
+    it->second->used = std::chrono::steady_clock::now();
+
+    buffer = it->second->buffer;
+    size = it->second->size;
+
+    return true;
+}
+
+void
+PieceCache::put(int piece, boost::shared_array<char> buffer, int size)
+{
+    D(printf("%s:%d: %s(%d, %d)\n", __FILE__, __LINE__, __func__, piece, size));
+
+    int64_t freed = 0;
+
+    // Budget locks itself and then caches when enforcing, so ask it before
+    // taking m_mtx
+    int64_t share = m_budget.fair_share();
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        if (m_pieces.count(piece))
+            return;
+
+        // Stay within our own capacity and our fair share of the budget
+        int64_t cap = std::min(m_capacity, share);
+
+        // It would only push itself out again
+        if (size > cap)
+            return;
+
+        m_lru.push_front(
+            { piece, buffer, size, std::chrono::steady_clock::now() });
+        m_pieces[piece] = m_lru.begin();
+        m_held += size;
+
+        while (m_held > cap && !m_lru.empty())
+            freed += evict_locked();
+    }
+
+    // Budget must not be called with m_mtx held, since it may call evict()
+    m_budget.release(this, freed);
+    m_budget.charge(this, size);
+}
+
+void
+PieceCache::clear()
+{
+    int64_t freed = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        while (!m_lru.empty())
+            freed += evict_locked();
+    }
+
+    m_budget.release(this, freed);
+}
+
+std::chrono::steady_clock::time_point
+PieceCache::coldest()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    if (m_lru.empty())
+        return std::chrono::steady_clock::time_point::max();
+
+    return m_lru.back().used;
+}
+
+int64_t
+PieceCache::evict()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    if (m_lru.empty())
+        return 0;
+
+    return evict_locked();
+}
+
+int64_t
+PieceCache::evict_locked()
+{
+    auto& e = m_lru.back();
+
+    D(printf("%s:%d: %s(%d)\n", __FILE__, __LINE__, __func__, e.piece));
+
+    int64_t size = e.size;
+
+    m_pieces.erase(e.piece);
+    m_lru.pop_back();
+    m_held -= size;
+
+    return size;
+}
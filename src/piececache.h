@@ -0,0 +1,91 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_PIECECACHE_H
+#define VLC_BITTORRENT_PIECECACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include <boost/shared_array.hpp>
+
+#include "memory.h"
+
+/**
+ * Recently read pieces of one download, so that reads that hit the same
+ * piece don't have to go through libtorrent again. Everything held is
+ * charged to a MemoryBudget, which may take it back at any time.
+ */
+class PieceCache : public MemoryConsumer {
+public:
+    PieceCache(const PieceCache&) = delete;
+    PieceCache&
+    operator=(const PieceCache&)
+        = delete;
+    PieceCache(MemoryBudget& budget, int64_t capacity);
+    ~PieceCache();
+
+    /**
+     * Look up a piece. Returns false if it's not cached.
+     */
+    bool
+    get(int piece, boost::shared_array<char>& buffer, int& size);
+
+    void
+    put(int piece, boost::shared_array<char> buffer, int size);
+
+    void
+    clear();
+
+    std::chrono::steady_clock::time_point
+    coldest() override;
+
+    int64_t
+    evict() override;
+
+private:
+    struct Entry {
+        int piece;
+        boost::shared_array<char> buffer;
+        int size;
+        std::chrono::steady_clock::time_point used;
+    };
+
+    // Called with m_mtx held
+    int64_t
+    evict_locked();
+
+    MemoryBudget& m_budget;
+
+    int64_t m_capacity;
+
+    std::mutex m_mtx;
+
+    int64_t m_held;
+
+    // Most recently used first
+    std::list<Entry> m_lru;
+
+    std::map<int, std::list<Entry>::iterator> m_pieces;
+};
+
+#endif
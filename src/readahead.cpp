@@ -0,0 +1,163 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+
+#include "readahead.h"
+
+#define D(x)
+
+#define kB (1024)
+#define MB (1024 * kB)
+
+// Window bounds in bytes
+#define WINDOW_MIN (4 * MB)
+#define WINDOW_MAX (256 * MB)
+
+// Window used until the consumption rate is known
+#define WINDOW_DEFAULT (32 * MB)
+
+// Seconds of playback to keep downloading ahead of the player
+#define WINDOW_TIME 30
+
+// Never download further ahead than the player will reach in this time
+#define WINDOW_HORIZON 60
+
+// Seconds of download to keep requested from the swarm
+#define WINDOW_DOWNLOAD_TIME 10
+
+// Caching bounds in milliseconds
+#define CACHING_MIN 1000
+#define CACHING_MAX 30000
+
+// Caching when there is nothing to go on, such as no peers yet
+#define CACHING_DEFAULT 10000
+
+// Milliseconds of caching when the download is as fast as the player
+#define CACHING_TIME 5000
+
+// Consumption rate assumed until it's known, around 8 Mbit/s
+#define MEDIA_RATE_DEFAULT (1 * MB)
+
+// Download rate assumed per connected peer until the rate is measured
+#define PEER_RATE_DEFAULT (64 * kB)
+
+// Length of a consumption rate sample period
+#define SAMPLE_PERIOD std::chrono::seconds(1)
+
+ReadAhead::ReadAhead()
+    : m_bytes(0)
+    , m_start(clock::now())
+    // Due right away. time_point::min() would overflow in due().
+    , m_sampled(clock::now() - SAMPLE_PERIOD)
+    , m_rate(0)
+    , m_download_rate(0)
+{
+}
+
+void
+ReadAhead::consumed(size_t size)
+{
+    D(printf("%s:%d: %s(%zu)\n", __FILE__, __LINE__, __func__, size));
+
+    m_bytes += (int64_t) size;
+
+    auto now = clock::now();
+    if (now - m_start < SAMPLE_PERIOD)
+        return;
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - m_start).count();
+
+    int64_t rate = m_bytes * 1000000 / std::max((int64_t) us, (int64_t) 1);
+
+    // Exponential moving average, weighted towards history
+    m_rate = m_rate ? (3 * m_rate + rate) / 4 : rate;
+
+    m_bytes = 0;
+    m_start = now;
+}
+
+void
+ReadAhead::downloading(int64_t rate)
+{
+    D(printf("%s:%d: %s(%ld)\n", __FILE__, __LINE__, __func__, rate));
+
+    m_download_rate = std::max(rate, (int64_t) 0);
+    m_sampled = clock::now();
+}
+
+bool
+ReadAhead::due()
+{
+    return clock::now() - m_sampled >= SAMPLE_PERIOD;
+}
+
+int64_t
+ReadAhead::rate()
+{
+    return m_rate;
+}
+
+int64_t
+ReadAhead::window()
+{
+    if (m_rate <= 0)
+        return WINDOW_DEFAULT;
+
+    // Enough for some seconds of playback, or enough to keep the swarm busy
+    // for some seconds if it's faster than the player, but not further ahead
+    // than the player will reach soon
+    int64_t w = std::min(
+        std::max(WINDOW_TIME * m_rate, WINDOW_DOWNLOAD_TIME * m_download_rate),
+        WINDOW_HORIZON * m_rate);
+
+    return std::min(std::max(w, (int64_t) WINDOW_MIN), (int64_t) WINDOW_MAX);
+}
+
+int64_t
+ReadAhead::caching(bool local, int peers)
+{
+    D(printf("%s:%d: %s(%d, %d)\n", __FILE__, __LINE__, __func__, local,
+        peers));
+
+    if (local)
+        return 0;
+
+    if (peers <= 0)
+        return CACHING_DEFAULT;
+
+    // Nothing is downloaded yet when the stream is opened, but peers may
+    // already be connected
+    int64_t download_rate = m_download_rate > 0
+        ? m_download_rate
+        : (int64_t) peers * PEER_RATE_DEFAULT;
+
+    int64_t media_rate = m_rate > 0 ? m_rate : MEDIA_RATE_DEFAULT;
+
+    // A swarm five times faster than playback needs a fifth of the time
+    int64_t ms = CACHING_TIME * media_rate / download_rate;
+
+    return std::min(
+        std::max(ms, (int64_t) CACHING_MIN), (int64_t) CACHING_MAX);
+}
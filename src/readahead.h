@@ -0,0 +1,96 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_READAHEAD_H
+#define VLC_BITTORRENT_READAHEAD_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Keeps track of how fast the player consumes data and how fast the data is
+ * downloaded, and sizes the read-ahead window from that. The window covers a
+ * number of seconds of playback, bounded in bytes.
+ */
+class ReadAhead {
+public:
+    ReadAhead();
+
+    /**
+     * Account for bytes handed to the player.
+     */
+    void
+    consumed(size_t size);
+
+    /**
+     * Account for a new sample of the download rate in bytes per second.
+     */
+    void
+    downloading(int64_t rate);
+
+    /**
+     * True if it's time to provide a new download rate sample.
+     */
+    bool
+    due();
+
+    /**
+     * Rate at which the player consumes data, in bytes per second. Zero
+     * until enough data has been consumed to tell.
+     */
+    int64_t
+    rate();
+
+    /**
+     * Number of bytes ahead of the current position to download with high
+     * priority.
+     */
+    int64_t
+    window();
+
+    /**
+     * Milliseconds of data to buffer before playback starts. Nothing if the
+     * data is already local, and more the harder the swarm has to work to
+     * keep up with the player. Until the download rate is measured, it's
+     * estimated from the number of peers.
+     */
+    int64_t
+    caching(bool local, int peers);
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    // Bytes consumed since start of current sample period
+    int64_t m_bytes;
+
+    // Start of current sample period
+    clock::time_point m_start;
+
+    // Time of last download rate sample
+    clock::time_point m_sampled;
+
+    // Smoothed consumption rate
+    int64_t m_rate;
+
+    // Last download rate sample
+    int64_t m_download_rate;
+};
+
+#endif
@@ -17,29 +17,214 @@ You should have received a copy of the GNU General Public License
 along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <fstream>
+#include <condition_variable>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/alert_types.hpp>
+#include <libtorrent/session_stats.hpp>
+#pragma GCC diagnostic pop
+
 #include "session.h"
+#include "timeline.h"
 
 #define D(x)
 #define DD(x)
 
+#define kB (1024)
+#define MB (1024 * kB)
+
+// Size of a bittorrent block
+#define BLOCK_SIZE (16 * kB)
+
+// How often to sample session counters
+#define STATS_INTERVAL std::chrono::seconds(5)
+
 #define LIBTORRENT_ADD_TORRENT_ALERTS \
     (lt::alert::storage_notification | lt::alert::piece_progress_notification \
+        | lt::alert::block_progress_notification \
         | lt::alert::status_notification | lt::alert::error_notification)
 
+// Block progress alerts come two per block, so leave room for a burst of
+// them without dropping piece and read alerts
+#define ALERT_QUEUE_SIZE 100000
+
+// How long to keep a pre-warmed session that nothing else uses
+#define PREWARM_HOLD std::chrono::seconds(60)
+
 #define LIBTORRENT_DHT_NODES \
     ("router.bittorrent.com:6881," \
      "router.utorrent.com:6881," \
      "dht.transmissionbt.com:6881")
 
-Session::Session(std::mutex& mtx)
-    : m_lock(mtx)
-    , m_session_thread_quit(false)
+// Settings passed to configure()
+static std::mutex configured_mtx;
+static lt::settings_pack configured;
+static int64_t configured_memory_limit = 0;
+static int configured_generation = 0;
+static std::string configured_metrics;
+
+// The session, if any, and the mutex it holds while it exists
+static std::mutex session_get_mtx;
+static std::mutex session_mtx;
+static std::weak_ptr<Session> session;
+
+/**
+ * Keeps a session created ahead of playback for a while, so it's still up
+ * when playback starts, but not for the life of the process.
+ */
+class Prewarmer {
+public:
+    Prewarmer()
+        : m_running(false)
+        , m_quit(false)
+    {
+    }
+
+    // Defined after Session::get()
+    ~Prewarmer();
+
+    void
+    start();
+
+private:
+    void
+    run();
+
+    std::mutex m_mtx;
+
+    std::condition_variable m_cv;
+
+    bool m_running;
+
+    bool m_quit;
+
+    std::thread m_thread;
+};
+
+// Declared after the above, so it's destroyed before them
+static Prewarmer prewarmer;
+
+static int
+hashing_threads()
 {
-    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+    int cores = std::max((int) std::thread::hardware_concurrency(), 1);
+
+    // Leave half the cores for everything else
+    return std::min(std::max(cores / 2, 1), 16);
+}
+
+static int
+aio_threads(bool rotational)
+{
+    int cores = std::max((int) std::thread::hardware_concurrency(), 1);
+
+    // Parallel requests to a spinning disk only make it seek more
+    if (rotational)
+        return 2;
+
+    return std::min(std::max(cores, 4), 32);
+}
+
+// Guess if path is on a spinning disk
+static bool
+is_rotational(const std::string& path)
+{
+#ifdef __linux__
+    struct stat st;
+    if (stat(path.c_str(), &st))
+        return false;
+
+    std::string dev = "/sys/dev/block/" + std::to_string(major(st.st_dev))
+        + ":" + std::to_string(minor(st.st_dev));
+
+    // Partitions don't have a queue of their own, their parent device does
+    for (auto p : { dev + "/queue/rotational", dev + "/../queue/rotational" }) {
+        std::ifstream is(p);
+        int rotational;
+        if (is >> rotational)
+            return rotational != 0;
+    }
+#endif
+
+    return false;
+}
+
+// Keep libtorrent's own buffers within a share of the memory limit
+static void
+fit_memory_limit(lt::settings_pack& sp, int64_t limit)
+{
+    if (limit <= 0)
+        return;
+
+    int64_t lo = BLOCK_SIZE;
+    int64_t hi = 256 * MB;
+
+    int disk = (int) std::min(std::max(limit / 4, lo), hi);
+    int send = (int) std::min(std::max(limit / 8, lo), hi);
+
+    sp.set_int(sp.max_queued_disk_bytes,
+        std::min(sp.get_int(sp.max_queued_disk_bytes), disk));
+    sp.set_int(sp.send_buffer_watermark,
+        std::min(sp.get_int(sp.send_buffer_watermark), send));
+}
+
+// Put settings in to that differ from from in delta. Returns how many.
+static int
+settings_delta(const lt::settings_pack& from, const lt::settings_pack& to,
+    lt::settings_pack& delta)
+{
+    int n = 0;
+
+    for (int i = 0; i < lt::settings_pack::num_string_settings; i++) {
+        int name = lt::settings_pack::string_type_base + i;
+        if (from.get_str(name) != to.get_str(name)) {
+            delta.set_str(name, to.get_str(name));
+            n++;
+        }
+    }
+
+    for (int i = 0; i < lt::settings_pack::num_int_settings; i++) {
+        int name = lt::settings_pack::int_type_base + i;
+        if (from.get_int(name) != to.get_int(name)) {
+            delta.set_int(name, to.get_int(name));
+            n++;
+        }
+    }
+
+    for (int i = 0; i < lt::settings_pack::num_bool_settings; i++) {
+        int name = lt::settings_pack::bool_type_base + i;
+        if (from.get_bool(name) != to.get_bool(name)) {
+            delta.set_bool(name, to.get_bool(name));
+            n++;
+        }
+    }
+
+    return n;
+}
 
+static lt::settings_pack
+base_settings()
+{
     lt::settings_pack sp = lt::default_settings();
 
+    // Scale disk and hashing with the machine
+    sp.set_int(sp.aio_threads, aio_threads(false));
+    sp.set_int(sp.hashing_threads, hashing_threads());
+
     sp.set_int(sp.alert_mask, LIBTORRENT_ADD_TORRENT_ALERTS);
+    sp.set_int(sp.alert_queue_size, ALERT_QUEUE_SIZE);
     sp.set_str(sp.dht_bootstrap_nodes, LIBTORRENT_DHT_NODES);
 
     /* Really aggressive settings to optimize time-to-play */
@@ -55,10 +240,48 @@ Session::Session(std::mutex& mtx)
     sp.set_int(sp.urlseed_max_request_bytes, 100 * 1024);
 #endif
 
+    return sp;
+}
+
+Session::Session(std::mutex& mtx)
+    : m_lock(mtx)
+    , m_session_thread_quit(false)
+    , m_settings_generation(0)
+    , m_hashed(0)
+    , m_hash_us(0)
+    , m_hash_rate(0)
+    , m_hash_thread_rate(0)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    lt::settings_pack sp = base_settings();
+
+    {
+        std::unique_lock<std::mutex> lock(configured_mtx);
+
+        if (configured_generation > 0)
+            sp = configured;
+
+        fit_memory_limit(sp, configured_memory_limit);
+        m_memory.set_limit(configured_memory_limit);
+
+        m_settings_generation = configured_generation;
+        m_applied = sp;
+    }
+
     m_session = std::make_unique<lt::session>(sp);
 
     m_session_thread = std::thread([&] {
+        auto next_stats = std::chrono::steady_clock::now();
+
         while (!m_session_thread_quit) {
+            if (std::chrono::steady_clock::now() >= next_stats) {
+                // Result arrives as a session_stats_alert
+                m_session->post_session_stats();
+
+                next_stats += STATS_INTERVAL;
+            }
+
             m_session->wait_for_alert(std::chrono::seconds(1));
 
             std::vector<lt::alert*> alerts;
@@ -66,7 +289,17 @@ Session::Session(std::mutex& mtx)
             // Get all pending requests
             m_session->pop_alerts(&alerts);
 
+            auto timeline = Timeline::get();
+
             for (auto* a : alerts) {
+                if (auto* x = lt::alert_cast<lt::session_stats_alert>(a))
+                    handle_session_stats(x);
+
+                m_peer_scores.handle_alert(a);
+
+                if (timeline)
+                    timeline->handle_alert(a);
+
                 std::unique_lock<std::mutex> lock(m_listeners_mtx);
 
                 for (auto* h : m_listeners) {
@@ -129,20 +362,283 @@ Session::remove_torrent(lt::torrent_handle& th, bool k)
         m_session->remove_torrent(th, lt::session::delete_files);
 }
 
+int
+Session::listen_port()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    return m_session->listen_port();
+}
+
+void
+Session::apply_settings(const lt::settings_pack& sp)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    m_session->apply_settings(sp);
+}
+
+void
+Session::tune_for_storage(const std::string& path)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    if (!is_rotational(path))
+        return;
+
+    // Only touch the thread count if nobody has set it explicitly
+    lt::settings_pack current = m_session->get_settings();
+    if (current.get_int(lt::settings_pack::aio_threads) != aio_threads(false))
+        return;
+
+    lt::settings_pack sp;
+    sp.set_int(lt::settings_pack::aio_threads, aio_threads(true));
+    m_session->apply_settings(sp);
+}
+
+std::string
+Session::get_stats()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::ostringstream os;
+
+    os << "hashing: " << m_hash_rate << " bytes/s (" << m_hash_thread_rate
+       << " bytes/s per thread)\n";
+    os << "memory: " << m_memory.get_used() << " bytes (limit "
+       << m_memory.get_limit() << " bytes)\n";
+    os << m_peer_scores.get_stats();
+
+    return os.str();
+}
+
+void
+Session::handle_session_stats(lt::session_stats_alert* a)
+{
+    static const int hashed_idx = lt::find_metric_idx("disk.num_blocks_hashed");
+    static const int time_idx = lt::find_metric_idx("disk.disk_hash_time");
+    static const int blocks_idx
+        = lt::find_metric_idx("disk.disk_blocks_in_use");
+
+    auto counters = a->counters();
+
+    m_metrics.add(std::vector<int64_t>(counters.begin(), counters.end()));
+
+    // Blocks held by libtorrent's disk buffer pool
+    if (blocks_idx >= 0)
+        m_memory.set_external(counters[blocks_idx] * BLOCK_SIZE);
+
+    if (hashed_idx < 0 || time_idx < 0)
+        return;
+
+    int64_t hashed = counters[hashed_idx] * BLOCK_SIZE;
+    int64_t hash_us = counters[time_idx];
+    auto now = std::chrono::steady_clock::now();
+
+    if (m_hash_sampled != std::chrono::steady_clock::time_point()) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - m_hash_sampled).count();
+
+        // Bytes hashed per second of wall clock time
+        if (us > 0)
+            m_hash_rate = (hashed - m_hashed) * 1000000 / us;
+
+        // Bytes hashed per second spent hashing
+        if (hash_us > m_hash_us)
+            m_hash_thread_rate
+                = (hashed - m_hashed) * 1000000 / (hash_us - m_hash_us);
+    }
+
+    m_hashed = hashed;
+    m_hash_us = hash_us;
+    m_hash_sampled = now;
+}
+
+// static
+lt::settings_pack
+Session::get_profile(const std::string& name)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, name.c_str()));
+
+    // Start from the defaults so switching profiles resets everything
+    lt::settings_pack sp = base_settings();
+
+    if (name.empty() || name == "low-latency") {
+        // Base settings are tuned for time-to-play already
+    } else if (name == "high-throughput") {
+        sp.set_int(sp.connections_limit, 500);
+        sp.set_int(sp.max_out_request_queue, 1500);
+        sp.set_int(sp.max_queued_disk_bytes, 64 * MB);
+        sp.set_int(sp.send_buffer_watermark, 4 * MB);
+        sp.set_int(sp.send_socket_buffer_size, 4 * MB);
+        sp.set_int(sp.recv_socket_buffer_size, 4 * MB);
+        sp.set_int(sp.request_queue_time, 3);
+        sp.set_int(sp.whole_pieces_threshold, 20);
+    } else if (name == "low-memory") {
+        sp.set_int(sp.connections_limit, 50);
+        sp.set_int(sp.max_out_request_queue, 250);
+        sp.set_int(sp.max_queued_disk_bytes, 1 * MB);
+        sp.set_int(sp.send_buffer_watermark, 512 * kB);
+        sp.set_int(sp.send_socket_buffer_size, 64 * kB);
+        sp.set_int(sp.recv_socket_buffer_size, 64 * kB);
+        sp.set_int(sp.aio_threads, 1);
+        sp.set_int(sp.hashing_threads, 1);
+    } else if (name == "seedbox") {
+        sp.set_int(sp.connections_limit, 1000);
+        sp.set_int(sp.unchoke_slots_limit, 50);
+        sp.set_int(sp.max_out_request_queue, 1500);
+        sp.set_int(sp.max_queued_disk_bytes, 16 * MB);
+        sp.set_int(sp.send_buffer_watermark, 4 * MB);
+        sp.set_int(sp.send_socket_buffer_size, 2 * MB);
+        sp.set_int(sp.recv_socket_buffer_size, 2 * MB);
+    } else {
+        throw std::runtime_error("Unknown profile " + name);
+    }
+
+    return sp;
+}
+
+// static
+void
+Session::configure(const lt::settings_pack& sp, int64_t memory_limit)
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::unique_lock<std::mutex> lock(configured_mtx);
+
+    // Every open configures, mostly with the same settings
+    lt::settings_pack delta;
+    if (configured_generation > 0 && memory_limit == configured_memory_limit
+        && settings_delta(configured, sp, delta) == 0)
+        return;
+
+    configured = sp;
+    configured_memory_limit = memory_limit;
+    configured_generation++;
+}
+
+// static
+void
+Session::configure_metrics(const std::string& path)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    std::unique_lock<std::mutex> lock(configured_mtx);
+
+    configured_metrics = path;
+}
+
+MemoryBudget&
+Session::memory()
+{
+    return m_memory;
+}
+
+PeerScores&
+Session::peer_scores()
+{
+    return m_peer_scores;
+}
+
 std::shared_ptr<Session>
 Session::get()
 {
     D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
 
-    static std::mutex mtx;
-    std::unique_lock<std::mutex> lock(mtx);
+    std::unique_lock<std::mutex> lock(session_get_mtx);
 
     // Re-use Session instance if possible, else create new instance
-    static std::weak_ptr<Session> session;
-    static std::mutex session_mtx;
     std::shared_ptr<Session> s = session.lock();
     if (!s)
         session = s = std::make_shared<Session>(session_mtx);
 
+    // Apply settings configured since the session was created
+    std::unique_lock<std::mutex> config_lock(configured_mtx);
+    if (s->m_settings_generation != configured_generation) {
+        lt::settings_pack sp = configured;
+        fit_memory_limit(sp, configured_memory_limit);
+
+        // Only what changed, so tuning done since, like by
+        // tune_for_storage(), stays unless it's configured differently
+        lt::settings_pack delta;
+        if (settings_delta(s->m_applied, sp, delta) > 0)
+            s->apply_settings(delta);
+        s->m_applied = sp;
+
+        s->m_memory.set_limit(configured_memory_limit);
+        s->m_settings_generation = configured_generation;
+    }
+
+    if (s->m_metrics.get_export_path() != configured_metrics) {
+        try {
+            s->m_metrics.export_to(configured_metrics);
+        } catch (std::runtime_error& e) {
+            D(printf("%s:%d: %s: %s\n", __FILE__, __LINE__, __func__,
+                e.what()));
+        }
+    }
+
     return s;
 }
+
+// static
+void
+Session::prewarm()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    prewarmer.start();
+}
+
+Prewarmer::~Prewarmer()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void
+Prewarmer::start()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    if (m_running || m_quit)
+        return;
+
+    // Previous hold has run out
+    if (m_thread.joinable())
+        m_thread.join();
+
+    m_running = true;
+    m_thread = std::thread(&Prewarmer::run, this);
+}
+
+void
+Prewarmer::run()
+{
+    std::shared_ptr<Session> s;
+
+    try {
+        // Openers meanwhile wait for this one in get()
+        s = Session::get();
+    } catch (std::exception& e) {
+        D(printf("%s:%d: %s: %s\n", __FILE__, __LINE__, __func__, e.what()));
+    }
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    m_cv.wait_for(lock, PREWARM_HOLD, [this] { return m_quit; });
+
+    m_running = false;
+
+    lock.unlock();
+
+    // Downloads started meanwhile hold their own references. If none did,
+    // the session goes away here.
+    s.reset();
+}
@@ -20,18 +20,27 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef VLC_BITTORRENT_LIBTORRENT_H
 #define VLC_BITTORRENT_LIBTORRENT_H
 
+#include <atomic>
+#include <chrono>
 #include <forward_list>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsign-conversion"
 #pragma GCC diagnostic ignored "-Wconversion"
 #include <libtorrent/alert.hpp>
+#include <libtorrent/alert_types.hpp>
 #include <libtorrent/session.hpp>
+#include <libtorrent/settings_pack.hpp>
 #pragma GCC diagnostic pop
 
+#include "memory.h"
+#include "metrics.h"
+#include "peerscores.h"
+
 struct Alert_Listener {
     virtual ~Alert_Listener() { }
 
@@ -57,9 +66,71 @@ public:
     void
     remove_torrent(lt::torrent_handle& th, bool k);
 
+    int
+    listen_port();
+
+    void
+    apply_settings(const lt::settings_pack& sp);
+
+    /**
+     * Adjust disk settings to the storage that path is on.
+     */
+    void
+    tune_for_storage(const std::string& path);
+
+    /**
+     * Summary of session wide statistics, one statistic per line.
+     */
+    std::string
+    get_stats();
+
+    /**
+     * Complete set of settings for a named tuning profile: "low-latency"
+     * (the default), "high-throughput", "low-memory" or "seedbox".
+     */
+    static lt::settings_pack
+    get_profile(const std::string& name);
+
+    /**
+     * Settings to use for the session. Applied right away if there is a
+     * session, else when it's created. A memory limit (in bytes, zero for
+     * no limit) caps libtorrent's buffers as well as everything charged to
+     * memory().
+     */
+    static void
+    configure(const lt::settings_pack& sp, int64_t memory_limit);
+
+    /**
+     * Export session counters to path, see Metrics::export_to(). Applied
+     * right away if there is a session, else when it's created. Empty to
+     * not export.
+     */
+    static void
+    configure_metrics(const std::string& path);
+
+    /**
+     * Memory budget shared by all downloads in this session.
+     */
+    MemoryBudget&
+    memory();
+
+    /**
+     * Latency and throughput of peers across all torrents.
+     */
+    PeerScores&
+    peer_scores();
+
     static std::shared_ptr<Session>
     get();
 
+    /**
+     * Create the session in a background thread, and keep it for a minute
+     * so it's up when playback starts. Callers of get() meanwhile wait for
+     * it instead of creating another.
+     */
+    static void
+    prewarm();
+
 private:
     // Locks mutex passed to constructor
     std::unique_lock<std::mutex> m_lock;
@@ -70,6 +141,32 @@ private:
 
     std::atomic<bool> m_session_thread_quit;
 
+    // Generation of configured settings last applied
+    int m_settings_generation;
+
+    // Configured settings last applied, to apply only changes
+    lt::settings_pack m_applied;
+
+    MemoryBudget m_memory;
+
+    PeerScores m_peer_scores;
+
+    Metrics m_metrics;
+
+    // Hashing counters at last sample, only used by the alert thread
+    int64_t m_hashed;
+
+    int64_t m_hash_us;
+
+    std::chrono::steady_clock::time_point m_hash_sampled;
+
+    std::atomic<int64_t> m_hash_rate;
+
+    std::atomic<int64_t> m_hash_thread_rate;
+
+    void
+    handle_session_stats(lt::session_stats_alert* a);
+
     std::forward_list<Alert_Listener*> m_listeners;
 
     std::mutex m_listeners_mtx;
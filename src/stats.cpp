@@ -0,0 +1,184 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <sstream>
+
+#include "stats.h"
+
+static const char* stage_names[] = {
+    "metadata",
+    "download",
+    "first_block",
+    "disk",
+    "copy",
+    "total",
+};
+
+Histogram::Histogram()
+    : m_count(0)
+    , m_sum(0)
+    , m_max(0)
+{
+    for (auto& b : m_buckets)
+        b = 0;
+}
+
+void
+Histogram::add(std::chrono::microseconds us)
+{
+    uint64_t v = (uint64_t) std::max(us.count(), (decltype(us.count())) 0);
+
+    // Bucket i holds values in [2^i, 2^(i+1))
+    size_t i = 0;
+    while (i < HISTOGRAM_BUCKETS - 1 && (v >> (i + 1)) > 0)
+        i++;
+
+    m_buckets[i]++;
+    m_count++;
+    m_sum += v;
+
+    uint64_t max = m_max;
+    while (v > max && !m_max.compare_exchange_weak(max, v)) {
+    }
+}
+
+uint64_t
+Histogram::count() const
+{
+    return m_count;
+}
+
+uint64_t
+Histogram::mean() const
+{
+    uint64_t count = m_count;
+    return count ? m_sum / count : 0;
+}
+
+uint64_t
+Histogram::max() const
+{
+    return m_max;
+}
+
+uint64_t
+Histogram::percentile(double p) const
+{
+    uint64_t count = m_count;
+    if (count == 0)
+        return 0;
+
+    auto target = (uint64_t) ((double) count * p / 100.0);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen > target)
+            return std::min((uint64_t) 1 << (i + 1), max());
+    }
+
+    return max();
+}
+
+ReadStats::ReadStats()
+    : m_start(std::chrono::steady_clock::now())
+    , m_stalls(0)
+    , m_stall_us(0)
+    , m_bytes(0)
+    , m_first_request(0)
+    , m_ttfb_us(0)
+{
+}
+
+void
+ReadStats::requested()
+{
+    int64_t zero = 0;
+    m_first_request.compare_exchange_strong(zero,
+        std::max((int64_t) std::chrono::steady_clock::now()
+                     .time_since_epoch()
+                     .count(),
+            (int64_t) 1));
+}
+
+void
+ReadStats::add(Stage stage, std::chrono::microseconds us)
+{
+    m_stages[stage].add(us);
+}
+
+void
+ReadStats::stall(std::chrono::microseconds us)
+{
+    m_stalls++;
+    m_stall_us += (uint64_t) us.count();
+}
+
+void
+ReadStats::served(size_t size)
+{
+    int64_t first = m_first_request;
+
+    if (size > 0 && first != 0 && m_ttfb_us == 0) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now()
+            - std::chrono::steady_clock::time_point(
+                std::chrono::steady_clock::duration(first)));
+
+        uint64_t zero = 0;
+        m_ttfb_us.compare_exchange_strong(
+            zero, std::max((uint64_t) us.count(), (uint64_t) 1));
+    }
+
+    m_bytes += size;
+}
+
+std::string
+ReadStats::dump() const
+{
+    std::ostringstream os;
+
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const Histogram& h = m_stages[i];
+
+        os << "stage " << stage_names[i] << ": count " << h.count()
+           << " mean " << h.mean() << " us p50 " << h.percentile(50)
+           << " us p99 " << h.percentile(99) << " us max " << h.max()
+           << " us\n";
+    }
+
+    os << "stalls: " << m_stalls << " total " << m_stall_us / 1000
+       << " ms\n";
+
+    os << "time to first byte: " << m_ttfb_us / 1000 << " ms\n";
+
+    auto s = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now() - m_start);
+
+    os << "served: " << m_bytes << " bytes ("
+       << m_bytes / (uint64_t) std::max(s.count(), (decltype(s.count())) 1)
+       << " bytes/s)\n";
+
+    return os.str();
+}
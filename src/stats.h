@@ -0,0 +1,138 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_STATS_H
+#define VLC_BITTORRENT_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#define HISTOGRAM_BUCKETS 32
+
+/**
+ * Latency histogram with power-of-two buckets in microseconds. Lock free so
+ * it can be updated from several threads.
+ */
+class Histogram {
+public:
+    Histogram();
+
+    void
+    add(std::chrono::microseconds us);
+
+    uint64_t
+    count() const;
+
+    uint64_t
+    mean() const;
+
+    uint64_t
+    max() const;
+
+    /**
+     * Upper bound of the bucket holding the given percentile (0-100).
+     */
+    uint64_t
+    percentile(double p) const;
+
+private:
+    std::atomic<uint64_t> m_buckets[HISTOGRAM_BUCKETS];
+
+    std::atomic<uint64_t> m_count;
+
+    std::atomic<uint64_t> m_sum;
+
+    std::atomic<uint64_t> m_max;
+};
+
+/**
+ * Where time goes when serving reads from a download. Time to first byte
+ * counts from the first read request, not from when the download was
+ * created, so it leaves out time spent idle before anyone asked for data.
+ */
+class ReadStats {
+public:
+    enum Stage {
+        // Waiting for metadata
+        STAGE_METADATA,
+        // Waiting for pieces to download
+        STAGE_DOWNLOAD,
+        // Waiting for the first block of a piece to arrive
+        STAGE_FIRST_BLOCK,
+        // Waiting for libtorrent to read a piece from disk
+        STAGE_DISK,
+        // Copying to the caller's buffer
+        STAGE_COPY,
+        // Whole read call
+        STAGE_TOTAL,
+        STAGE_COUNT
+    };
+
+    ReadStats();
+
+    /**
+     * Account for a read request. The first one starts the clock for time
+     * to first byte.
+     */
+    void
+    requested();
+
+    void
+    add(Stage stage, std::chrono::microseconds us);
+
+    /**
+     * Account for a read that had to wait for a piece to download.
+     */
+    void
+    stall(std::chrono::microseconds us);
+
+    /**
+     * Account for bytes handed to the caller.
+     */
+    void
+    served(size_t size);
+
+    /**
+     * Human readable summary, one line per statistic.
+     */
+    std::string
+    dump() const;
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+
+    Histogram m_stages[STAGE_COUNT];
+
+    std::atomic<uint64_t> m_stalls;
+
+    std::atomic<uint64_t> m_stall_us;
+
+    std::atomic<uint64_t> m_bytes;
+
+    // When the first read was requested, in steady clock ticks, or zero
+    std::atomic<int64_t> m_first_request;
+
+    // Time from first request to first byte served, or zero if none served
+    // yet
+    std::atomic<uint64_t> m_ttfb_us;
+};
+
+#endif
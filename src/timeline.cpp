@@ -0,0 +1,255 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <atomic>
+#include <sstream>
+#include <stdexcept>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/alert_types.hpp>
+#pragma GCC diagnostic pop
+
+#include "timeline.h"
+
+#define D(x)
+
+// Reader threads are numbered from here, clear of piece numbers
+#define READER_TID_BASE (1 << 30)
+
+static std::mutex configured_mtx;
+static std::shared_ptr<Timeline> configured;
+static std::string configured_path;
+
+// Number of the calling thread, for telling readers apart
+static int
+reader_number()
+{
+    static std::atomic<int> next(0);
+    thread_local int n = next++;
+    return n;
+}
+
+// Enough of the info hash to tell torrents apart
+static std::string
+short_hash(const lt::sha1_hash& ih)
+{
+    static const char chars[] = "0123456789abcdef";
+
+    std::string result;
+    for (auto byte : ih.to_string().substr(0, 4)) {
+        result += chars[(byte >> 4) & 0x0F];
+        result += chars[byte & 0x0F];
+    }
+    return result;
+}
+
+Timeline::Timeline(const std::string& path)
+    : m_os(path, std::ios::trunc)
+    , m_start(clock::now())
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    if (!m_os)
+        throw std::runtime_error("Failed to open timeline file " + path);
+
+    // The closing bracket is optional, so the file is usable even if the
+    // process never gets to close it
+    m_os << "[\n";
+}
+
+// static
+void
+Timeline::configure(const std::string& path)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    std::unique_lock<std::mutex> lock(configured_mtx);
+
+    if (path == configured_path)
+        return;
+
+    configured = path.empty() ? nullptr : std::make_shared<Timeline>(path);
+    configured_path = path;
+}
+
+// static
+std::shared_ptr<Timeline>
+Timeline::get()
+{
+    std::unique_lock<std::mutex> lock(configured_mtx);
+
+    return configured;
+}
+
+void
+Timeline::prioritized(const lt::sha1_hash& ih, int piece, int prio)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        auto& p = m_pieces[std::make_pair(ih, piece)];
+        if (p.prioritized == clock::time_point())
+            p.prioritized = clock::now();
+    }
+
+    piece_event(ih, piece, "prioritized", "priority", prio);
+}
+
+void
+Timeline::piece_span(const lt::sha1_hash& ih, int piece, const char* name,
+    clock::time_point start, clock::time_point end)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    std::ostringstream os;
+    os << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":"
+       << torrent_id(ih) << ",\"tid\":" << piece << ",\"ts\":" << us(start)
+       << ",\"dur\":" << us(end) - us(start) << "}";
+
+    write(os.str());
+}
+
+void
+Timeline::piece_event(const lt::sha1_hash& ih, int piece, const char* name,
+    const char* arg, int64_t value)
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    std::ostringstream os;
+    os << "{\"name\":\"" << name << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":"
+       << torrent_id(ih) << ",\"tid\":" << piece
+       << ",\"ts\":" << us(clock::now()) << ",\"args\":{\"" << arg
+       << "\":" << value << "}}";
+
+    write(os.str());
+}
+
+void
+Timeline::reader_span(const lt::sha1_hash& ih, int piece, const char* name,
+    clock::time_point start, clock::time_point end)
+{
+    int n = reader_number();
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    int pid = torrent_id(ih);
+    int tid = READER_TID_BASE + n;
+
+    std::ostringstream os;
+
+    if (m_readers.insert(std::make_pair(pid, n)).second) {
+        os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+           << ",\"tid\":" << tid << ",\"args\":{\"name\":\"reader " << n
+           << "\"}}";
+        write(os.str());
+        os.str("");
+    }
+
+    os << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":" << pid
+       << ",\"tid\":" << tid << ",\"ts\":" << us(start)
+       << ",\"dur\":" << us(end) - us(start) << ",\"args\":{\"piece\":"
+       << piece << "}}";
+
+    write(os.str());
+}
+
+void
+Timeline::handle_alert(lt::alert* a)
+{
+    if (auto* x = lt::alert_cast<lt::block_finished_alert>(a)) {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        auto& p = m_pieces[std::make_pair(
+            x->handle.info_hash(), static_cast<int>(x->piece_index))];
+
+        auto now = clock::now();
+        if (p.first_block == clock::time_point())
+            p.first_block = now;
+        p.last_block = now;
+    } else if (auto* x = lt::alert_cast<lt::piece_finished_alert>(a)) {
+        lt::sha1_hash ih = x->handle.info_hash();
+        int piece = static_cast<int>(x->piece_index);
+
+        PieceTimes p;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+
+            auto it = m_pieces.find(std::make_pair(ih, piece));
+            if (it == m_pieces.end())
+                return;
+
+            p = it->second;
+            m_pieces.erase(it);
+        }
+
+        // Web seed pieces are added whole, without blocks
+        if (p.first_block == clock::time_point())
+            return;
+
+        auto now = clock::now();
+
+        if (p.prioritized != clock::time_point()
+            && p.prioritized < p.first_block)
+            piece_span(ih, piece, "queued", p.prioritized, p.first_block);
+
+        piece_span(ih, piece, "transfer", p.first_block, p.last_block);
+        piece_span(ih, piece, "hash", p.last_block, now);
+    }
+}
+
+// Called with m_mtx held
+int
+Timeline::torrent_id(const lt::sha1_hash& ih)
+{
+    auto it = m_torrents.find(ih);
+    if (it != m_torrents.end())
+        return it->second;
+
+    int id = (int) m_torrents.size() + 1;
+    m_torrents[ih] = id;
+
+    std::ostringstream os;
+    os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << id
+       << ",\"args\":{\"name\":\"torrent " << short_hash(ih) << "\"}}";
+    write(os.str());
+
+    return id;
+}
+
+// Called with m_mtx held
+void
+Timeline::write(const std::string& event)
+{
+    m_os << event << ",\n";
+    m_os.flush();
+}
+
+int64_t
+Timeline::us(clock::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - m_start)
+        .count();
+}
@@ -0,0 +1,141 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef VLC_BITTORRENT_TIMELINE_H
+#define VLC_BITTORRENT_TIMELINE_H
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/alert.hpp>
+#include <libtorrent/sha1_hash.hpp>
+#pragma GCC diagnostic pop
+
+namespace lt = libtorrent;
+
+/**
+ * Timeline of what happens to each piece, written in the Chrome trace event
+ * format for chrome://tracing or ui.perfetto.dev. Each torrent is a process
+ * and each piece a thread, with spans for waiting for the first block,
+ * transferring, hash checking and reading from disk. Readers get threads of
+ * their own, with spans for each read and time blocked on a piece.
+ */
+class Timeline {
+public:
+    using clock = std::chrono::steady_clock;
+
+    Timeline(const Timeline&) = delete;
+    Timeline&
+    operator=(const Timeline&)
+        = delete;
+    Timeline(const std::string& path);
+
+    /**
+     * Write the timeline to path, truncating it. Empty turns it off.
+     * Pieces already being tracked are forgotten.
+     */
+    static void
+    configure(const std::string& path);
+
+    /**
+     * The configured timeline, or nullptr if it's off.
+     */
+    static std::shared_ptr<Timeline>
+    get();
+
+    /**
+     * Piece was given a higher priority.
+     */
+    void
+    prioritized(const lt::sha1_hash& ih, int piece, int prio);
+
+    /**
+     * Span on the piece's own thread.
+     */
+    void
+    piece_span(const lt::sha1_hash& ih, int piece, const char* name,
+        clock::time_point start, clock::time_point end);
+
+    /**
+     * Marker on the piece's own thread, with a single numeric argument.
+     */
+    void
+    piece_event(const lt::sha1_hash& ih, int piece, const char* name,
+        const char* arg, int64_t value);
+
+    /**
+     * Span on the calling reader's thread.
+     */
+    void
+    reader_span(const lt::sha1_hash& ih, int piece, const char* name,
+        clock::time_point start, clock::time_point end);
+
+    /**
+     * Track block and piece completion. Called from the session's alert
+     * thread.
+     */
+    void
+    handle_alert(lt::alert* a);
+
+private:
+    struct PieceTimes {
+        clock::time_point prioritized;
+
+        clock::time_point first_block;
+
+        clock::time_point last_block;
+    };
+
+    // Called with m_mtx held
+    int
+    torrent_id(const lt::sha1_hash& ih);
+
+    // Called with m_mtx held
+    void
+    write(const std::string& event);
+
+    int64_t
+    us(clock::time_point t);
+
+    std::mutex m_mtx;
+
+    std::ofstream m_os;
+
+    clock::time_point m_start;
+
+    // Torrents are numbered in the order seen
+    std::map<lt::sha1_hash, int> m_torrents;
+
+    // Reader threads that have been named, per torrent
+    std::set<std::pair<int, int>> m_readers;
+
+    std::map<std::pair<lt::sha1_hash, int>, PieceTimes> m_pieces;
+};
+
+#endif
@@ -0,0 +1,140 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include "trace.h"
+
+#define D(x)
+
+TraceWriter::TraceWriter(const std::string& path)
+    : m_os(path, std::ios::binary | std::ios::app)
+    , m_start(std::chrono::steady_clock::now())
+    , m_streams(0)
+{
+    D(printf("%s:%d: %s(%s)\n", __FILE__, __LINE__, __func__, path.c_str()));
+
+    if (!m_os)
+        throw std::runtime_error("Failed to open trace file " + path);
+
+    // Each run starts a new trace, so times start over
+    m_os.write(TRACE_MAGIC, 8);
+}
+
+// static
+std::shared_ptr<TraceWriter>
+TraceWriter::get(const std::string& path)
+{
+    static std::mutex mtx;
+    std::unique_lock<std::mutex> lock(mtx);
+
+    static std::map<std::string, std::weak_ptr<TraceWriter>> writers;
+
+    std::shared_ptr<TraceWriter> w = writers[path].lock();
+    if (!w)
+        writers[path] = w = std::make_shared<TraceWriter>(path);
+
+    return w;
+}
+
+uint16_t
+TraceWriter::new_stream()
+{
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    return m_streams++;
+}
+
+void
+TraceWriter::add(uint16_t stream, int file, int64_t offset, size_t size,
+    std::chrono::microseconds latency, uint8_t flags)
+{
+    TraceRecord r;
+    memset(&r, 0, sizeof(r));
+
+    auto now = std::chrono::steady_clock::now();
+
+    r.time_us = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+        now - m_start).count();
+    r.offset = offset;
+    r.size = (uint32_t) size;
+    r.latency_us = (uint32_t) latency.count();
+    r.file = file;
+    r.stream = stream;
+    r.flags = flags;
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    m_os.write((const char*) &r, sizeof(r));
+    m_os.flush();
+}
+
+std::vector<TraceRecord>
+read_trace(const std::string& path)
+{
+    std::ifstream is(path, std::ios::binary);
+    if (!is)
+        throw std::runtime_error("Failed to open trace file " + path);
+
+    std::vector<TraceRecord> records;
+
+    // A file appended to by several runs has several headers. Later runs
+    // are moved to start after the previous one ended, and get streams of
+    // their own.
+    uint64_t base = 0;
+    uint64_t last = 0;
+    uint16_t stream_base = 0;
+    uint16_t streams = 0;
+
+    char magic[8];
+    if (!is.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, 8) != 0)
+        throw std::runtime_error("Not a trace file " + path);
+
+    for (;;) {
+        TraceRecord r;
+        if (!is.read((char*) &r, 8))
+            break;
+
+        if (memcmp(&r, TRACE_MAGIC, 8) == 0) {
+            base = last;
+            stream_base = streams;
+            continue;
+        }
+
+        if (!is.read((char*) &r + 8, sizeof(r) - 8))
+            throw std::runtime_error("Truncated trace file " + path);
+
+        r.time_us += base;
+        last = r.time_us;
+
+        r.stream = (uint16_t) (r.stream + stream_base);
+        streams = std::max(streams, (uint16_t) (r.stream + 1));
+
+        records.push_back(r);
+    }
+
+    return records;
+}
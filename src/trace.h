@@ -0,0 +1,109 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_TRACE_H
+#define VLC_BITTORRENT_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Written at the start of every trace file
+#define TRACE_MAGIC "VBTRACE1"
+
+/**
+ * One read or seek done by a player. Stored as is, in host byte order.
+ */
+struct TraceRecord {
+    enum Flags : uint8_t {
+        // Position change, size and latency are zero
+        FLAG_SEEK = 1,
+        // All of the data was downloaded already
+        FLAG_HIT = 2,
+        // The read failed or hit end of file
+        FLAG_FAILED = 4,
+    };
+
+    // Microseconds since the trace was started
+    uint64_t time_us;
+
+    int64_t offset;
+
+    uint32_t size;
+
+    uint32_t latency_us;
+
+    int32_t file;
+
+    // Tells apart streams read at the same time
+    uint16_t stream;
+
+    uint8_t flags;
+
+    uint8_t reserved;
+};
+
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord must be packed");
+
+/**
+ * Appends trace records to a file. All streams in the process tracing to the
+ * same file share one writer.
+ */
+class TraceWriter {
+public:
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter&
+    operator=(const TraceWriter&)
+        = delete;
+    TraceWriter(const std::string& path);
+
+    static std::shared_ptr<TraceWriter>
+    get(const std::string& path);
+
+    /**
+     * Number to tell this stream's records apart from others.
+     */
+    uint16_t
+    new_stream();
+
+    void
+    add(uint16_t stream, int file, int64_t offset, size_t size,
+        std::chrono::microseconds latency, uint8_t flags);
+
+private:
+    std::mutex m_mtx;
+
+    std::ofstream m_os;
+
+    std::chrono::steady_clock::time_point m_start;
+
+    uint16_t m_streams;
+};
+
+/**
+ * Read all records of a trace file. Throws if it isn't one.
+ */
+std::vector<TraceRecord>
+read_trace(const std::string& path);
+
+#endif
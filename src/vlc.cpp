@@ -21,12 +21,16 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cerrno>
 
+#include <limits>
 #include <memory>
 #include <stdexcept>
 #include <string>
 
+#include "session.h"
+#include "timeline.h"
 #include "vlc.h"
 
 std::string
@@ -91,3 +95,138 @@ get_keep_files(vlc_object_t* p_this)
 {
     return var_InheritBool(p_this, KEEP_CONFIG);
 }
+
+int
+get_pause_upload_limit(vlc_object_t* p_this)
+{
+    // Configured in kB/s
+    int64_t value = std::max(
+        var_InheritInteger(p_this, PAUSE_UPLOAD_CONFIG), (int64_t) 0);
+    return (int) std::min(value, (int64_t) std::numeric_limits<int>::max() / 1024)
+        * 1024;
+}
+
+std::string
+get_stats_file(vlc_object_t* p_this)
+{
+    std::unique_ptr<char, decltype(&free)> path(
+        var_InheritString(p_this, STATS_CONFIG), free);
+
+    return path ? std::string(path.get()) : std::string();
+}
+
+std::string
+get_trace_file(vlc_object_t* p_this)
+{
+    std::unique_ptr<char, decltype(&free)> path(
+        var_InheritString(p_this, TRACE_CONFIG), free);
+
+    return path ? std::string(path.get()) : std::string();
+}
+
+std::string
+get_storage_mode(vlc_object_t* p_this)
+{
+    std::unique_ptr<char, decltype(&free)> mode(
+        var_InheritString(p_this, STORAGE_MODE_CONFIG), free);
+
+    return mode ? std::string(mode.get()) : std::string();
+}
+
+bool
+get_selective_files(vlc_object_t* p_this)
+{
+    return var_InheritBool(p_this, SELECTIVE_CONFIG);
+}
+
+int64_t
+get_max_listed_files(vlc_object_t* p_this)
+{
+    return std::max(
+        var_InheritInteger(p_this, MAX_LISTED_CONFIG), (int64_t) 0);
+}
+
+std::string
+get_daemon_socket(vlc_object_t* p_this)
+{
+    std::unique_ptr<char, decltype(&free)> path(
+        var_InheritString(p_this, DAEMON_CONFIG), free);
+
+    return path ? std::string(path.get()) : std::string();
+}
+
+static void
+override_setting(vlc_object_t* p_this, const char* name, lt::settings_pack& sp,
+    int setting, int64_t scale)
+{
+    // Zero means use the value from the profile
+    int64_t value = var_InheritInteger(p_this, name);
+    if (value > 0)
+        sp.set_int(setting,
+            (int) std::min(value, std::numeric_limits<int>::max() / scale)
+                * (int) scale);
+}
+
+void
+configure_session(vlc_object_t* p_this)
+{
+    std::unique_ptr<char, decltype(&free)> profile(
+        var_InheritString(p_this, PROFILE_CONFIG), free);
+
+    lt::settings_pack sp
+        = Session::get_profile(profile ? profile.get() : "");
+
+    override_setting(
+        p_this, CONNECTIONS_CONFIG, sp, lt::settings_pack::connections_limit, 1);
+    override_setting(p_this, DISK_QUEUE_CONFIG, sp,
+        lt::settings_pack::max_queued_disk_bytes, 1024);
+    override_setting(
+        p_this, AIO_THREADS_CONFIG, sp, lt::settings_pack::aio_threads, 1);
+    override_setting(p_this, HASHING_THREADS_CONFIG, sp,
+        lt::settings_pack::hashing_threads, 1);
+    override_setting(p_this, SEND_BUFFER_CONFIG, sp,
+        lt::settings_pack::send_socket_buffer_size, 1024);
+    override_setting(p_this, RECV_BUFFER_CONFIG, sp,
+        lt::settings_pack::recv_socket_buffer_size, 1024);
+    override_setting(p_this, DOWNLOAD_RATE_CONFIG, sp,
+        lt::settings_pack::download_rate_limit, 1024);
+    override_setting(p_this, UPLOAD_RATE_CONFIG, sp,
+        lt::settings_pack::upload_rate_limit, 1024);
+
+    // Configured in MB
+    int64_t memory_limit = var_InheritInteger(p_this, MEMORY_CONFIG) * 1024 * 1024;
+
+    Session::configure(sp, memory_limit);
+
+    std::unique_ptr<char, decltype(&free)> metrics(
+        var_InheritString(p_this, METRICS_CONFIG), free);
+
+    Session::configure_metrics(metrics ? metrics.get() : "");
+
+    std::unique_ptr<char, decltype(&free)> timeline(
+        var_InheritString(p_this, TIMELINE_CONFIG), free);
+
+    try {
+        Timeline::configure(timeline ? timeline.get() : "");
+    } catch (std::runtime_error& e) {
+        msg_Warn(p_this, "No piece timeline: %s", e.what());
+    }
+}
+
+void
+prewarm_session(vlc_object_t* p_this)
+{
+    if (!var_InheritBool(p_this, PREWARM_CONFIG))
+        return;
+
+    // The daemon's session is what will be used
+    if (!get_daemon_socket(p_this).empty())
+        return;
+
+    try {
+        configure_session(p_this);
+        Session::prewarm();
+    } catch (std::runtime_error& e) {
+        msg_Dbg(p_this, "Not pre-warming session: %s", e.what());
+    }
+}
@@ -60,6 +60,26 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 
 #define DLDIR_CONFIG "bittorrent-download-path"
 #define KEEP_CONFIG "bittorrent-keep-files"
+#define PAUSE_UPLOAD_CONFIG "bittorrent-pause-upload-limit"
+#define STATS_CONFIG "bittorrent-stats-file"
+#define PROFILE_CONFIG "bittorrent-profile"
+#define CONNECTIONS_CONFIG "bittorrent-connections-limit"
+#define DISK_QUEUE_CONFIG "bittorrent-max-queued-disk"
+#define AIO_THREADS_CONFIG "bittorrent-aio-threads"
+#define HASHING_THREADS_CONFIG "bittorrent-hashing-threads"
+#define SEND_BUFFER_CONFIG "bittorrent-send-buffer"
+#define RECV_BUFFER_CONFIG "bittorrent-recv-buffer"
+#define DOWNLOAD_RATE_CONFIG "bittorrent-download-rate-limit"
+#define UPLOAD_RATE_CONFIG "bittorrent-upload-rate-limit"
+#define MEMORY_CONFIG "bittorrent-memory-limit"
+#define DAEMON_CONFIG "bittorrent-daemon-socket"
+#define STORAGE_MODE_CONFIG "bittorrent-storage-mode"
+#define SELECTIVE_CONFIG "bittorrent-selective-files"
+#define TRACE_CONFIG "bittorrent-trace-file"
+#define METRICS_CONFIG "bittorrent-metrics-file"
+#define TIMELINE_CONFIG "bittorrent-timeline-file"
+#define PREWARM_CONFIG "bittorrent-prewarm"
+#define MAX_LISTED_CONFIG "bittorrent-max-listed-files"
 
 std::string
 get_download_directory(vlc_object_t* p_this);
@@ -70,4 +90,47 @@ get_cache_directory(vlc_object_t* p_this);
 bool
 get_keep_files(vlc_object_t* p_this);
 
+int
+get_pause_upload_limit(vlc_object_t* p_this);
+
+std::string
+get_stats_file(vlc_object_t* p_this);
+
+std::string
+get_trace_file(vlc_object_t* p_this);
+
+std::string
+get_storage_mode(vlc_object_t* p_this);
+
+bool
+get_selective_files(vlc_object_t* p_this);
+
+/**
+ * Number of files of a torrent above which only media and subtitle files
+ * are listed, or 0 to list all files.
+ */
+int64_t
+get_max_listed_files(vlc_object_t* p_this);
+
+/**
+ * Unix socket of a vlc-bittorrentd to attach to, or empty to download
+ * in-process.
+ */
+std::string
+get_daemon_socket(vlc_object_t* p_this);
+
+/**
+ * Pass the tuning profile and overrides from the configuration on to the
+ * libtorrent session.
+ */
+void
+configure_session(vlc_object_t* p_this);
+
+/**
+ * Start the libtorrent session in the background, if configured to, so
+ * it's up by the time something is played.
+ */
+void
+prewarm_session(vlc_object_t* p_this);
+
 #endif
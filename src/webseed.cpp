@@ -0,0 +1,269 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <sstream>
+
+#include <sys/socket.h>
+
+#include "webseed.h"
+
+#define D(x)
+
+// Give up on a request that takes longer than this
+#define WEBSEED_TIMEOUT std::chrono::seconds(10)
+
+// Give up on connecting sooner, as a connect can't be cancelled
+#define WEBSEED_CONNECT_TIMEOUT std::chrono::seconds(2)
+
+static std::string
+escape_path(const std::string& path)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    std::string result;
+    for (char ch : path) {
+        auto c = (unsigned char) ch;
+
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'
+            || c == '~' || c == '/') {
+            result += (char) c;
+        } else if (c == '\\') {
+            result += '/';
+        } else {
+            result += '%';
+            result += hex[c >> 4];
+            result += hex[c & 0xF];
+        }
+    }
+
+    return result;
+}
+
+// Split http://host[:port]/path
+static bool
+parse_url(const std::string& url, std::string& host, std::string& port,
+    std::string& path)
+{
+    static const std::string scheme = "http://";
+
+    if (url.compare(0, scheme.size(), scheme) != 0)
+        return false;
+
+    size_t start = scheme.size();
+    size_t slash = url.find('/', start);
+    if (slash == std::string::npos)
+        slash = url.size();
+
+    std::string authority = url.substr(start, slash - start);
+
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']') == std::string::npos) {
+        host = authority.substr(0, colon);
+        port = authority.substr(colon + 1);
+    } else {
+        host = authority;
+        port = "80";
+    }
+
+    path = slash < url.size() ? url.substr(slash) : "/";
+
+    return !host.empty();
+}
+
+// Send the request on a connected stream and read the body into buf
+static bool
+request(boost::asio::ip::tcp::iostream& s, const std::string& host,
+    const std::string& path, int64_t off, char* buf, size_t len)
+{
+    s << "GET " << path << " HTTP/1.1\r\n"
+      << "Host: " << host << "\r\n"
+      << "Range: bytes=" << off << "-" << off + (int64_t) len - 1 << "\r\n"
+      << "User-Agent: vlc-bittorrent\r\n"
+      << "Connection: close\r\n\r\n"
+      << std::flush;
+
+    std::string version;
+    int status = 0;
+    s >> version >> status;
+
+    // Servers that ignore the range send the whole file. Redirects aren't
+    // followed, they and anything else fail the fetch.
+    if (!s || (status != 206 && !(status == 200 && off == 0)))
+        return false;
+
+    // Rest of status line, then headers
+    std::string line;
+    std::getline(s, line);
+
+    while (std::getline(s, line)) {
+        if (line.empty() || line == "\r")
+            break;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(),
+            [](unsigned char c) { return (char) std::tolower(c); });
+
+        std::string value = line.substr(colon + 1);
+        std::transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char c) { return (char) std::tolower(c); });
+
+        // The body is read as is, so it must not be chunked or compressed
+        if ((name == "transfer-encoding" || name == "content-encoding")
+            && value.find("identity") == std::string::npos)
+            return false;
+
+        // Has to be the range asked for
+        if (name == "content-range") {
+            std::ostringstream expected;
+            expected << "bytes " << off << "-";
+            if (value.find(expected.str()) == std::string::npos)
+                return false;
+        }
+    }
+
+    if (!s)
+        return false;
+
+    s.read(buf, (std::streamsize) len);
+
+    return s.gcount() == (std::streamsize) len;
+}
+
+WebSeed::WebSeed(const std::string& url)
+    : m_url(url)
+    , m_cancelled(false)
+    , m_failures(0)
+    , m_bytes(0)
+    , m_busy_us(0)
+{
+}
+
+std::string
+WebSeed::file_url(const std::string& path, bool single_file) const
+{
+    // Single file torrents may point right at the file
+    if (single_file && !m_url.empty() && m_url.back() != '/')
+        return m_url;
+
+    std::string url = m_url;
+    if (url.empty() || url.back() != '/')
+        url += '/';
+
+    return url + escape_path(path);
+}
+
+bool
+WebSeed::fetch(const std::string& url, int64_t off, char* buf, size_t len)
+{
+    D(printf("%s:%d: %s(%s, %ld, %lu)\n", __FILE__, __LINE__, __func__,
+        url.c_str(), off, len));
+
+    std::string host, port, path;
+    if (len == 0 || !parse_url(url, host, port, path)) {
+        m_failures++;
+        return false;
+    }
+
+    if (m_cancelled) {
+        m_failures++;
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    boost::asio::ip::tcp::iostream s;
+    s.expires_after(WEBSEED_CONNECT_TIMEOUT);
+    s.connect(host, port);
+    s.expires_after(WEBSEED_TIMEOUT);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        if (m_cancelled || !s) {
+            m_failures++;
+            return false;
+        }
+
+        m_streams.insert(&s);
+    }
+
+    bool ok = request(s, host, path, off, buf, len);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        m_streams.erase(&s);
+    }
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    m_latency.add(us);
+    m_busy_us += (uint64_t) us.count();
+
+    if (!ok) {
+        m_failures++;
+        return false;
+    }
+
+    m_bytes += len;
+
+    return true;
+}
+
+void
+WebSeed::cancel()
+{
+    D(printf("%s:%d: %s()\n", __FILE__, __LINE__, __func__));
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    m_cancelled = true;
+
+    // Wakes up whatever the fetch is waiting for with an error
+    for (auto* s : m_streams)
+        shutdown(s->socket().native_handle(), SHUT_RDWR);
+}
+
+std::string
+WebSeed::get_stats() const
+{
+    std::ostringstream os;
+
+    uint64_t busy_us = m_busy_us;
+
+    os << "webseed " << m_url << ": " << m_latency.count() << " requests, "
+       << m_failures << " failed, mean " << m_latency.mean() << " us, p95 "
+       << m_latency.percentile(95) << " us, "
+       << (busy_us ? m_bytes * 1000000 / busy_us : 0) << " bytes/s\n";
+
+    return os.str();
+}
@@ -0,0 +1,97 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_WEBSEED_H
+#define VLC_BITTORRENT_WEBSEED_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <boost/asio/ip/tcp.hpp>
+#pragma GCC diagnostic pop
+
+#include "stats.h"
+
+/**
+ * A BEP 19 web seed that can be asked for exact byte ranges of a file, so
+ * the piece a reader is blocked on can be fetched without waiting for the
+ * swarm. Only plain http is supported.
+ */
+class WebSeed {
+public:
+    WebSeed(const WebSeed&) = delete;
+    WebSeed&
+    operator=(const WebSeed&)
+        = delete;
+    WebSeed(const std::string& url);
+
+    /**
+     * URL of a file in the torrent, following BEP 19. The path is relative
+     * to the save path, which means it starts with the torrent name for
+     * multi-file torrents.
+     */
+    std::string
+    file_url(const std::string& path, bool single_file) const;
+
+    /**
+     * Fetch len bytes starting at off of the file at url. Returns false if
+     * the server didn't give us exactly that.
+     */
+    bool
+    fetch(const std::string& url, int64_t off, char* buf, size_t len);
+
+    /**
+     * Make fetches in progress give up within a short while, and later ones
+     * fail right away.
+     */
+    void
+    cancel();
+
+    /**
+     * Request latency and throughput, one statistic per line.
+     */
+    std::string
+    get_stats() const;
+
+private:
+    std::string m_url;
+
+    std::mutex m_mtx;
+
+    std::atomic<bool> m_cancelled;
+
+    // Connections of fetches in progress
+    std::set<boost::asio::ip::tcp::iostream*> m_streams;
+
+    Histogram m_latency;
+
+    std::atomic<uint64_t> m_failures;
+
+    std::atomic<uint64_t> m_bytes;
+
+    std::atomic<uint64_t> m_busy_us;
+};
+
+#endif
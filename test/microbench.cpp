@@ -0,0 +1,150 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Micro-benchmarks for the per-read hot path. Torrents are created locally
+with all data present, so nothing is downloaded and only the overhead of
+the Download and Session code (and libtorrent calls it makes) is measured.
+Data is written to the microbench directory.
+*/
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "download.h"
+#include "session.h"
+#include "swarm.h"
+
+#define kB (1024)
+
+#define DIR "microbench"
+
+// Small pieces give many pieces without too much data on disk
+#define PIECE_SIZE (16 * kB)
+
+static std::shared_ptr<Download>
+get_torrent(const std::string& name, const std::vector<int64_t>& sizes)
+{
+    static std::map<std::string, std::shared_ptr<Download>> cache;
+
+    auto& d = cache[name];
+    if (!d) {
+        auto md = make_torrent(DIR, name, sizes, PIECE_SIZE);
+
+        // Data is already in place, so keep it when done
+        d = Download::get_download(md.data(), md.size(), DIR, true);
+    }
+
+    return d;
+}
+
+static std::shared_ptr<Download>
+get_pieces_torrent(int64_t pieces)
+{
+    return get_torrent("pieces-" + std::to_string(pieces),
+        { pieces * PIECE_SIZE });
+}
+
+static std::shared_ptr<Download>
+get_files_torrent(int64_t files)
+{
+    return get_torrent("files-" + std::to_string(files),
+        std::vector<int64_t>((size_t) files, 1 * kB));
+}
+
+// One 16 kB read from a torrent with all pieces present
+static void
+BM_Read(benchmark::State& state)
+{
+    int64_t pieces = state.range(0);
+
+    auto d = get_pieces_torrent(pieces);
+
+    std::vector<char> buf(PIECE_SIZE);
+
+    int64_t piece = 0;
+    for (auto _ : state) {
+        ssize_t r = d->read(0, piece * PIECE_SIZE, buf.data(), buf.size());
+        if (r <= 0) {
+            state.SkipWithError("read failed");
+            break;
+        }
+
+        // Spread reads over the whole torrent
+        piece = (piece + 7919) % pieces;
+    }
+
+    state.SetBytesProcessed(state.iterations() * PIECE_SIZE);
+}
+BENCHMARK(BM_Read)->Arg(1000)->Arg(10000)->Arg(100000)->UseRealTime();
+
+// Look up the last file by path in a torrent with many files
+static void
+BM_GetFile(benchmark::State& state)
+{
+    int64_t files = state.range(0);
+
+    auto d = get_files_torrent(files);
+
+    auto list = d->get_files();
+    std::string path = list.back().first;
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(d->get_file(path));
+}
+BENCHMARK(BM_GetFile)->Arg(1000)->Arg(10000)->UseRealTime();
+
+struct IdleListener : public Alert_Listener {
+    void
+    handle_alert(lt::alert*) override
+    {
+    }
+};
+
+// Read round trips with many alert listeners registered in the Session
+static void
+BM_AlertDispatch(benchmark::State& state)
+{
+    auto d = get_pieces_torrent(1000);
+
+    auto session = Session::get();
+
+    std::vector<IdleListener> listeners((size_t) state.range(0));
+    for (auto& l : listeners)
+        session->register_alert_listener(&l);
+
+    std::vector<char> buf(PIECE_SIZE);
+
+    for (auto _ : state) {
+        if (d->read(0, 0, buf.data(), buf.size()) <= 0) {
+            state.SkipWithError("read failed");
+            break;
+        }
+    }
+
+    for (auto& l : listeners)
+        session->unregister_alert_listener(&l);
+}
+BENCHMARK(BM_AlertDispatch)->Arg(0)->Arg(16)->Arg(256)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -33,6 +33,8 @@ along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
 #include <libtorrent/version.hpp>
 #pragma GCC diagnostic pop
 
+#include "swarm.h"
+
 namespace lt = libtorrent;
 
 #define ALERTS \
@@ -43,13 +45,8 @@ int
 main(int argc, char const* argv[])
 {
     try {
-        lt::settings_pack p;
+        lt::settings_pack p = seeder_settings();
         p.set_int(lt::settings_pack::alert_mask, ALERTS);
-        p.set_bool(lt::settings_pack::enable_lsd, true);
-        p.set_bool(lt::settings_pack::enable_upnp, false);
-        p.set_bool(lt::settings_pack::enable_natpmp, false);
-        p.set_bool(lt::settings_pack::enable_dht, false);
-        p.set_bool(lt::settings_pack::broadcast_lsd, true);
 
         lt::session ses(p);
 
@@ -0,0 +1,99 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Checks that PieceCache keeps its memory budget in step with what it holds.
+Prints TAP.
+*/
+
+#include <iostream>
+#include <string>
+
+#include "memory.h"
+#include "piececache.h"
+
+#define PIECE_SIZE 4096
+
+static int test_number = 0;
+
+static void
+check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "ok " : "not ok ") << ++test_number << " - " << what
+              << std::endl;
+}
+
+static boost::shared_array<char>
+piece()
+{
+    return boost::shared_array<char>(new char[PIECE_SIZE]);
+}
+
+static bool
+cached(PieceCache& cache, int index)
+{
+    boost::shared_array<char> buffer;
+    int size;
+
+    return cache.get(index, buffer, size);
+}
+
+int
+main()
+{
+    std::cout << "1..6" << std::endl;
+
+    {
+        // Capacity smaller than one piece
+        MemoryBudget budget;
+        PieceCache cache(budget, PIECE_SIZE / 2);
+
+        cache.put(0, piece(), PIECE_SIZE);
+
+        check(!cached(cache, 0), "piece over capacity not cached");
+        check(budget.get_used() == 0, "piece over capacity not charged");
+    }
+
+    {
+        // Budget smaller than one piece
+        MemoryBudget budget;
+        budget.set_limit(PIECE_SIZE / 2);
+        PieceCache cache(budget, 16 * PIECE_SIZE);
+
+        cache.put(0, piece(), PIECE_SIZE);
+
+        check(budget.get_used() == 0, "piece over fair share not charged");
+    }
+
+    {
+        // Room for two pieces
+        MemoryBudget budget;
+        PieceCache cache(budget, 2 * PIECE_SIZE);
+
+        cache.put(0, piece(), PIECE_SIZE);
+        cache.put(1, piece(), PIECE_SIZE);
+        cache.put(2, piece(), PIECE_SIZE);
+
+        check(!cached(cache, 0), "oldest piece evicted");
+        check(cached(cache, 1) && cached(cache, 2), "newest pieces kept");
+        check(budget.get_used() == 2 * PIECE_SIZE, "charged what is held");
+    }
+
+    return 0;
+}
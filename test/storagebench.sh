@@ -0,0 +1,58 @@
+#!/bin/bash
+# Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+#
+# This file is part of vlc-bittorrent.
+#
+# vlc-bittorrent is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# vlc-bittorrent is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+
+# Compare storage modes on one or more file systems. Give a directory on
+# each file system to test, for example on ext4, xfs and tmpfs:
+#
+#   test/storagebench.sh /mnt/ext4 /mnt/xfs /dev/shm
+#
+# Results are printed one per line as
+#
+#   STORAGEBENCH <fs> <mode> <pattern> <metric> <value>
+
+set -o pipefail
+
+# Benchmark binary
+STREAMBENCH_BIN=${STREAMBENCH_BIN:-$(dirname "$0")/streambench}
+
+# Passed on to streambench, such as --size or --seeders
+STREAMBENCH_ARGS=${STREAMBENCH_ARGS:---size 256}
+
+if [ $# -eq 0 ]; then
+	echo "Usage: $0 DIR..." >&2
+	exit 1
+fi
+
+for dir in "$@"; do
+	fs=$(stat -f -c %T "$dir") || exit 1
+
+	for mode in sparse allocate region; do
+		work="$dir/storagebench-$mode"
+
+		rm -rf "$work"
+
+		# Index first is the case that fragments sparse files the most
+		for pattern in index sequential; do
+			"$STREAMBENCH_BIN" $STREAMBENCH_ARGS --dir "$work" \
+				--storage-mode $mode --pattern $pattern |
+				sed -n "s/^STREAMBENCH \(.* .* .*\)$/STORAGEBENCH $fs $mode \1/p"
+		done
+
+		rm -rf "$work"
+	done
+done
@@ -0,0 +1,394 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Streaming benchmark. Creates a synthetic torrent, seeds it from a few local
+seeders and reads it through the Download API using access patterns
+similar to a media player. Results are printed one per line as
+
+    STREAMBENCH <pattern> <metric> <value>
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "download.h"
+#include "session.h"
+#include "swarm.h"
+
+#define kB (1024)
+#define MB (1024 * kB)
+
+using clock_type = std::chrono::steady_clock;
+
+static int seeders = 3;
+static int64_t size = 256 * MB;
+static int piece_size = 1 * MB;
+static size_t chunk = 64 * kB;
+static int seeks = 20;
+static std::string dir = "streambench";
+static std::string pattern = "all";
+static bool webseed = false;
+static std::string storage_mode = "sparse";
+static int pipeline = 1;
+
+// Web seed for all torrents, if enabled
+static std::unique_ptr<HttpSeed> http_seed;
+
+static double
+ms_since(clock_type::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t)
+        .count();
+}
+
+static double
+percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0;
+
+    std::sort(v.begin(), v.end());
+
+    auto i = (size_t) ((double) (v.size() - 1) * p / 100.0);
+
+    return v[i];
+}
+
+static void
+report(const std::string& name, const std::string& metric, double value)
+{
+    std::cout << "STREAMBENCH " << name << " " << metric << " " << value
+              << std::endl;
+}
+
+// Where the data came from, as reported by the download
+static void
+report_sources(const std::string& name, std::shared_ptr<Download> d)
+{
+    std::istringstream is(d->get_stats());
+    for (std::string line; std::getline(is, line);) {
+        if (line.compare(0, 6, "swarm:") == 0
+            || line.compare(0, 8, "webseed ") == 0)
+            std::cout << "STREAMBENCH " << name << " source " << line
+                      << std::endl;
+    }
+}
+
+static void
+report_latencies(const std::string& name, const std::vector<double>& lat)
+{
+    report(name, "reads", (double) lat.size());
+    report(name, "read_p50_ms", percentile(lat, 50));
+    report(name, "read_p99_ms", percentile(lat, 99));
+}
+
+// Read len bytes at off, recording latency of each read call
+static int64_t
+read_range(std::shared_ptr<Download> d, int64_t off, int64_t len,
+    std::vector<double>& lat)
+{
+    std::vector<char> buf(chunk);
+
+    int64_t total = 0;
+    while (total < len) {
+        auto t = clock_type::now();
+
+        ssize_t r = d->read(0, off + total, buf.data(),
+            (size_t) std::min((int64_t) buf.size(), len - total));
+        if (r <= 0)
+            break;
+
+        lat.push_back(ms_since(t));
+
+        total += r;
+    }
+
+    return total;
+}
+
+// One outstanding read, reused for the next chunk when done
+struct Slot {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done;
+    ssize_t len;
+    std::exception_ptr error;
+    std::vector<char> buf;
+    int64_t off;
+    size_t size;
+};
+
+// Same as read_range, but with several reads in flight at once. Latency is
+// the time spent waiting for each chunk.
+static int64_t
+read_range_pipelined(std::shared_ptr<Download> d, int64_t off, int64_t len,
+    std::vector<double>& lat)
+{
+    std::vector<std::unique_ptr<Slot>> slots;
+    for (int i = 0; i < pipeline; i++) {
+        slots.push_back(std::make_unique<Slot>());
+        slots.back()->buf.resize(chunk);
+        slots.back()->done = true;
+    }
+
+    int64_t next = off;
+
+    auto issue = [&](Slot& s) {
+        s.done = false;
+        s.off = next;
+        s.size = (size_t) std::min((int64_t) chunk, off + len - next);
+
+        next += (int64_t) s.size;
+
+        d->async_read(0, s.off, s.buf.data(), s.size, (int64_t) chunk * 8,
+            [&s](ssize_t n, std::exception_ptr error) {
+                std::unique_lock<std::mutex> lock(s.mtx);
+
+                s.len = n;
+                s.error = error;
+                s.done = true;
+                s.cv.notify_all();
+            });
+    };
+
+    auto wait = [](Slot& s) {
+        std::unique_lock<std::mutex> lock(s.mtx);
+        s.cv.wait(lock, [&s] { return s.done; });
+    };
+
+    for (auto& s : slots) {
+        if (next < off + len)
+            issue(*s);
+    }
+
+    int64_t total = 0;
+    std::exception_ptr error;
+
+    for (size_t i = 0; total < len && !error; i = (i + 1) % slots.size()) {
+        Slot& s = *slots[i];
+
+        auto t = clock_type::now();
+
+        wait(s);
+
+        if (s.error) {
+            error = s.error;
+            break;
+        } else if (s.len <= 0) {
+            break;
+        }
+
+        // Reads stop at piece boundaries, so fill in the rest if needed
+        int64_t got = s.len;
+        while (got < (int64_t) s.size) {
+            ssize_t r = d->read(0, s.off + got, s.buf.data() + got,
+                s.size - (size_t) got);
+            if (r <= 0)
+                break;
+
+            got += r;
+        }
+
+        lat.push_back(ms_since(t));
+
+        total += got;
+
+        if (next < off + len)
+            issue(s);
+    }
+
+    // Completions refer to the slots
+    for (auto& s : slots)
+        wait(*s);
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return total;
+}
+
+// Start a download of a fresh torrent seeded by a local swarm
+static std::shared_ptr<Download>
+start(const std::string& name, std::unique_ptr<Swarm>& swarm)
+{
+    std::string seed_path = dir + "/seed";
+    std::string dl_path = dir + "/download";
+
+    auto md = make_torrent(seed_path, name, { size }, piece_size,
+        http_seed ? http_seed->url() : std::string());
+
+    swarm = std::make_unique<Swarm>(seeders, md, seed_path);
+
+    // Allocate mode pays for the whole file here
+    auto t = clock_type::now();
+
+    auto d = Download::get_download(md.data(), md.size(), dl_path, false,
+        Download::get_storage_mode(storage_mode), true);
+
+    // Like the plugin, which attaches to the file it plays
+    d->open_file(0);
+
+    report(name, "open_ms", ms_since(t));
+
+    swarm->connect(Session::get()->listen_port());
+
+    return d;
+}
+
+static void
+bench_sequential()
+{
+    std::unique_ptr<Swarm> swarm;
+
+    auto d = start("sequential", swarm);
+
+    auto t = clock_type::now();
+
+    std::vector<double> lat;
+    int64_t total = pipeline > 1 ? read_range_pipelined(d, 0, size, lat)
+                                 : read_range(d, 0, size, lat);
+
+    double ms = ms_since(t);
+
+    report("sequential", "ttfb_ms", lat.empty() ? 0 : lat[0]);
+    report("sequential", "bytes", (double) total);
+    report("sequential", "throughput_mbps",
+        (double) total * 8 / 1000 / std::max(ms, 1.0));
+    report_latencies("sequential", lat);
+    report_sources("sequential", d);
+}
+
+static void
+bench_seek()
+{
+    std::unique_ptr<Swarm> swarm;
+
+    auto d = start("seek", swarm);
+
+    std::mt19937_64 rng(1);
+    std::uniform_int_distribution<int64_t> dist(0, size - 1);
+
+    std::vector<double> lat;
+    std::vector<double> resume;
+
+    // Start playing, then jump around like a user scrubbing
+    read_range(d, 0, 4 * MB, lat);
+
+    for (int i = 0; i < seeks; i++) {
+        int64_t off = dist(rng);
+
+        auto t = clock_type::now();
+        read_range(d, off, (int64_t) chunk, lat);
+        resume.push_back(ms_since(t));
+
+        read_range(d, off + (int64_t) chunk, 1 * MB, lat);
+    }
+
+    report("seek", "seek_resume_p50_ms", percentile(resume, 50));
+    report("seek", "seek_resume_p99_ms", percentile(resume, 99));
+    report_latencies("seek", lat);
+    report_sources("seek", d);
+}
+
+static void
+bench_index()
+{
+    std::unique_ptr<Swarm> swarm;
+
+    auto d = start("index", swarm);
+
+    auto t = clock_type::now();
+
+    std::vector<double> lat;
+
+    // Demuxers often look for the index at the end before playing
+    int64_t tail = std::min(size, (int64_t) 1 * MB);
+    read_range(d, size - tail, tail, lat);
+    read_range(d, 0, (int64_t) chunk, lat);
+
+    report("index", "ttfb_ms", ms_since(t));
+    report_latencies("index", lat);
+    report_sources("index", d);
+}
+
+int
+main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--seeders" && i + 1 < argc) {
+            seeders = std::stoi(argv[++i]);
+        } else if (arg == "--size" && i + 1 < argc) {
+            size = std::stoll(argv[++i]) * MB;
+        } else if (arg == "--piece-size" && i + 1 < argc) {
+            piece_size = std::stoi(argv[++i]) * kB;
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            chunk = (size_t) std::stoul(argv[++i]) * kB;
+        } else if (arg == "--seeks" && i + 1 < argc) {
+            seeks = std::stoi(argv[++i]);
+        } else if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (arg == "--pattern" && i + 1 < argc) {
+            pattern = argv[++i];
+        } else if (arg == "--webseed") {
+            webseed = true;
+        } else if (arg == "--storage-mode" && i + 1 < argc) {
+            storage_mode = argv[++i];
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            pipeline = std::max(std::stoi(argv[++i]), 1);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--seeders N] [--size MB] [--piece-size kB]"
+                         " [--chunk kB] [--seeks N] [--dir PATH]"
+                         " [--pattern all|sequential|seek|index]"
+                         " [--webseed] [--storage-mode sparse|allocate|region]"
+                         " [--pipeline N]"
+                      << std::endl;
+            return -1;
+        }
+    }
+
+    try {
+        if (webseed)
+            http_seed = std::make_unique<HttpSeed>(dir + "/seed");
+
+        if (pattern == "all" || pattern == "sequential")
+            bench_sequential();
+        if (pattern == "all" || pattern == "seek")
+            bench_seek();
+        if (pattern == "all" || pattern == "index")
+            bench_index();
+    } catch (std::runtime_error& e) {
+        std::cout << "STREAMBENCH FAIL " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "STREAMBENCH END" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <libtorrent/add_torrent_params.hpp>
+#include <libtorrent/address.hpp>
+#include <libtorrent/alert.hpp>
+#include <libtorrent/bencode.hpp>
+#include <libtorrent/create_torrent.hpp>
+#include <libtorrent/socket.hpp>
+#include <libtorrent/torrent_flags.hpp>
+#include <libtorrent/torrent_info.hpp>
+#pragma GCC diagnostic pop
+
+#include "swarm.h"
+
+static void
+make_directory(const std::string& path)
+{
+    // Create parents first
+    for (size_t i = path.find('/', 1); i != std::string::npos;
+         i = path.find('/', i + 1))
+        make_directory(path.substr(0, i));
+
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0777);
+#endif
+}
+
+static void
+write_random(const std::string& path, int64_t size, std::mt19937_64& rng)
+{
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os)
+        throw std::runtime_error("Failed to create " + path);
+
+    std::vector<uint64_t> block(128 * 1024);
+
+    while (size > 0) {
+        std::generate(block.begin(), block.end(), std::ref(rng));
+
+        auto len = std::min(size, (int64_t) (block.size() * sizeof(uint64_t)));
+        os.write((const char*) block.data(), (std::streamsize) len);
+
+        size -= len;
+    }
+}
+
+lt::settings_pack
+seeder_settings()
+{
+    lt::settings_pack p;
+    p.set_int(lt::settings_pack::alert_mask, lt::alert::error_notification);
+    p.set_bool(lt::settings_pack::enable_lsd, true);
+    p.set_bool(lt::settings_pack::enable_upnp, false);
+    p.set_bool(lt::settings_pack::enable_natpmp, false);
+    p.set_bool(lt::settings_pack::enable_dht, false);
+    p.set_bool(lt::settings_pack::broadcast_lsd, true);
+    return p;
+}
+
+std::vector<char>
+make_torrent(const std::string& dir, const std::string& name,
+    const std::vector<int64_t>& sizes, int piece_size,
+    const std::string& web_seed)
+{
+    // Same content every time for the same name
+    std::seed_seq seed(name.begin(), name.end());
+    std::mt19937_64 rng(seed);
+
+    make_directory(dir);
+
+    std::string root = dir + "/" + name;
+
+    if (sizes.size() == 1) {
+        write_random(root, sizes[0], rng);
+    } else {
+        make_directory(root);
+
+        for (size_t i = 0; i < sizes.size(); i++)
+            write_random(
+                root + "/" + std::to_string(i) + ".bin", sizes[i], rng);
+    }
+
+    lt::file_storage fs;
+    lt::add_files(fs, root);
+
+    lt::create_torrent ct(fs, piece_size);
+    lt::set_piece_hashes(ct, dir);
+
+    if (!web_seed.empty())
+        ct.add_url_seed(web_seed);
+
+    std::vector<char> metadata;
+    lt::bencode(std::back_inserter(metadata), ct.generate());
+
+    return metadata;
+}
+
+Seeder::Seeder(const std::vector<char>& metadata, const std::string& save_path)
+{
+    lt::settings_pack sp = seeder_settings();
+    sp.set_str(lt::settings_pack::listen_interfaces, "127.0.0.1:0");
+
+    m_session = std::make_unique<lt::session>(sp);
+
+    lt::error_code ec;
+
+    lt::add_torrent_params atp;
+    atp.ti = std::make_shared<lt::torrent_info>(
+        metadata.data(), (int) metadata.size(), std::ref(ec));
+    if (ec)
+        throw std::runtime_error("Failed to parse metadata");
+
+    atp.save_path = save_path;
+    atp.flags |= lt::torrent_flags::seed_mode;
+    atp.flags &= ~lt::torrent_flags::auto_managed;
+    atp.flags &= ~lt::torrent_flags::paused;
+
+    m_th = m_session->add_torrent(atp);
+}
+
+void
+Seeder::connect(int port)
+{
+    m_th.connect_peer(lt::tcp::endpoint(
+        lt::make_address_v4("127.0.0.1"), (unsigned short) port));
+}
+
+Swarm::Swarm(int seeders, const std::vector<char>& metadata,
+    const std::string& save_path)
+{
+    for (int i = 0; i < seeders; i++)
+        m_seeders.push_back(std::make_unique<Seeder>(metadata, save_path));
+}
+
+void
+Swarm::connect(int port)
+{
+    for (auto& s : m_seeders)
+        s->connect(port);
+}
+
+static std::string
+unescape(const std::string& s)
+{
+    std::string result;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '%' && i + 2 < s.size()) {
+            result += (char) std::stoi(s.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        } else {
+            result += s[i];
+        }
+    }
+    return result;
+}
+
+HttpSeed::HttpSeed(const std::string& root)
+    : m_root(root)
+    , m_quit(false)
+    , m_acceptor(m_io,
+          boost::asio::ip::tcp::endpoint(
+              boost::asio::ip::make_address_v4("127.0.0.1"), 0))
+{
+    m_thread = std::thread([this] {
+        while (true) {
+            auto s = std::make_shared<boost::asio::ip::tcp::iostream>();
+
+            boost::system::error_code ec;
+            m_acceptor.accept(s->socket(), ec);
+
+            if (m_quit)
+                break;
+            if (ec)
+                continue;
+
+            s->expires_after(std::chrono::seconds(30));
+
+            m_connections.emplace_back([this, s] { serve(*s); });
+        }
+    });
+}
+
+HttpSeed::~HttpSeed()
+{
+    m_quit = true;
+
+    // Wake up the accepting thread
+    boost::asio::ip::tcp::iostream s("127.0.0.1", std::to_string(port()));
+
+    m_thread.join();
+
+    for (auto& t : m_connections)
+        t.join();
+}
+
+int
+HttpSeed::port()
+{
+    return m_acceptor.local_endpoint().port();
+}
+
+std::string
+HttpSeed::url()
+{
+    return "http://127.0.0.1:" + std::to_string(port()) + "/";
+}
+
+void
+HttpSeed::serve(std::iostream& s)
+{
+    std::string method, target, version;
+    if (!(s >> method >> target >> version))
+        return;
+
+    // Rest of request line
+    std::string rest;
+    std::getline(s, rest);
+
+    bool range = false;
+    int64_t first = 0;
+    int64_t last = -1;
+
+    for (std::string line; std::getline(s, line);) {
+        if (line.empty() || line == "\r")
+            break;
+
+        std::string lower = line;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+        long long a = 0, b = -1;
+        if (sscanf(lower.c_str(), "range: bytes=%lld-%lld", &a, &b) >= 1) {
+            range = true;
+            first = a;
+            last = b;
+        }
+    }
+
+    std::ifstream f(m_root + unescape(target), std::ios::binary);
+    if (method != "GET" || !f) {
+        s << "HTTP/1.1 404 Not Found\r\n"
+          << "Content-Length: 0\r\n"
+          << "Connection: close\r\n\r\n"
+          << std::flush;
+        return;
+    }
+
+    f.seekg(0, std::ios::end);
+    int64_t size = (int64_t) f.tellg();
+
+    if (last < 0 || last >= size)
+        last = size - 1;
+
+    if (first > last) {
+        s << "HTTP/1.1 416 Range Not Satisfiable\r\n"
+          << "Content-Length: 0\r\n"
+          << "Connection: close\r\n\r\n"
+          << std::flush;
+        return;
+    }
+
+    s << "HTTP/1.1 " << (range ? "206 Partial Content" : "200 OK") << "\r\n"
+      << "Content-Length: " << last - first + 1 << "\r\n";
+    if (range)
+        s << "Content-Range: bytes " << first << "-" << last << "/" << size
+          << "\r\n";
+    s << "Connection: close\r\n\r\n";
+
+    f.seekg(first);
+
+    std::vector<char> buf(64 * 1024);
+    for (int64_t left = last - first + 1; left > 0 && s;) {
+        auto len = std::min(left, (int64_t) buf.size());
+        if (!f.read(buf.data(), (std::streamsize) len))
+            break;
+
+        s.write(buf.data(), (std::streamsize) len);
+        left -= len;
+    }
+
+    s.flush();
+}
@@ -0,0 +1,128 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VLC_BITTORRENT_TEST_SWARM_H
+#define VLC_BITTORRENT_TEST_SWARM_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsign-conversion"
+#pragma GCC diagnostic ignored "-Wconversion"
+#include <boost/asio/ip/tcp.hpp>
+#include <libtorrent/session.hpp>
+#include <libtorrent/settings_pack.hpp>
+#include <libtorrent/torrent_handle.hpp>
+#pragma GCC diagnostic pop
+
+namespace lt = libtorrent;
+
+/**
+ * Settings for a local seeder: LSD on, DHT and port mapping off.
+ */
+lt::settings_pack
+seeder_settings();
+
+/**
+ * Write files with the given sizes and random content to dir/name and
+ * create a torrent for them. A single size gives a single-file torrent.
+ * If web_seed is set, it's added as a BEP 19 web seed. Returns the
+ * bencoded metadata.
+ */
+std::vector<char>
+make_torrent(const std::string& dir, const std::string& name,
+    const std::vector<int64_t>& sizes, int piece_size,
+    const std::string& web_seed = std::string());
+
+/**
+ * A session seeding a torrent from local files.
+ */
+class Seeder {
+public:
+    Seeder(const std::vector<char>& metadata, const std::string& save_path);
+
+    /**
+     * Connect to a peer listening on the loopback interface.
+     */
+    void
+    connect(int port);
+
+private:
+    std::unique_ptr<lt::session> m_session;
+
+    lt::torrent_handle m_th;
+};
+
+/**
+ * Local swarm of seeders sharing the same torrent.
+ */
+class Swarm {
+public:
+    Swarm(int seeders, const std::vector<char>& metadata,
+        const std::string& save_path);
+
+    void
+    connect(int port);
+
+private:
+    std::vector<std::unique_ptr<Seeder>> m_seeders;
+};
+
+/**
+ * Minimal HTTP server on the loopback interface serving files below root,
+ * with support for range requests. Stands in for a web seed.
+ */
+class HttpSeed {
+public:
+    HttpSeed(const std::string& root);
+    ~HttpSeed();
+
+    int
+    port();
+
+    /**
+     * URL to use as web seed for torrents created in root.
+     */
+    std::string
+    url();
+
+private:
+    void
+    serve(std::iostream& s);
+
+    std::string m_root;
+
+    std::atomic<bool> m_quit;
+
+    boost::asio::io_context m_io;
+
+    boost::asio::ip::tcp::acceptor m_acceptor;
+
+    std::thread m_thread;
+
+    std::list<std::thread> m_connections;
+};
+
+#endif
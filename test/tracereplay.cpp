@@ -0,0 +1,261 @@
+/*
+Copyright 2026 Johan Gunnarsson <johan.gunnarsson@gmail.com>
+
+This file is part of vlc-bittorrent.
+
+vlc-bittorrent is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+vlc-bittorrent is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with vlc-bittorrent.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/*
+Trace replayer. Reads a trace recorded with --bittorrent-trace-file, creates
+a synthetic torrent big enough to cover every read in it, seeds it from a
+few local seeders and replays the reads through the Download API with the
+recorded timing. Streams are replayed concurrently, one thread each.
+Results are printed one per line as
+
+    TRACEREPLAY <metric> <value>
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "download.h"
+#include "readahead.h"
+#include "session.h"
+#include "swarm.h"
+#include "trace.h"
+
+#define kB (1024)
+#define MB (1024 * kB)
+
+using clock_type = std::chrono::steady_clock;
+
+static int seeders = 3;
+static int piece_size = 1 * MB;
+static std::string dir = "tracereplay";
+static double speed = 1.0;
+static double stall_ms = 100;
+
+static double
+percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0;
+
+    std::sort(v.begin(), v.end());
+
+    auto i = (size_t) ((double) (v.size() - 1) * p / 100.0);
+
+    return v[i];
+}
+
+static void
+report(const std::string& metric, double value)
+{
+    std::cout << "TRACEREPLAY " << metric << " " << value << std::endl;
+}
+
+struct Result {
+    std::mutex mtx;
+
+    std::vector<double> lat;
+
+    int hits = 0;
+
+    int stalls = 0;
+
+    int failed = 0;
+
+    // How far behind the recorded timing the replay ended up
+    double lag_ms = 0;
+};
+
+// Replay the records of one stream, in order, at the recorded times
+static void
+replay(std::shared_ptr<Download> d, const std::vector<TraceRecord>& records,
+    const std::map<int, int>& files, clock_type::time_point t0, Result& res)
+{
+    ReadAhead readahead;
+    std::vector<char> buf;
+
+    for (auto& r : records) {
+        auto due = t0
+            + std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<double, std::micro>(
+                    (double) r.time_us / speed));
+        std::this_thread::sleep_until(due);
+
+        if (r.flags & TraceRecord::FLAG_SEEK)
+            continue;
+
+        int file = files.at(r.file);
+
+        if (readahead.due())
+            readahead.downloading(d->get_download_rate());
+
+        buf.resize(r.size);
+
+        auto t = clock_type::now();
+
+        bool hit = false;
+        ssize_t n = -1;
+        try {
+            hit = d->is_local(file, r.offset, r.size);
+            n = d->read(file, r.offset, buf.data(), buf.size(),
+                readahead.window(), nullptr);
+        } catch (std::runtime_error& e) {
+        }
+
+        auto now = clock_type::now();
+        double ms = std::chrono::duration<double, std::milli>(now - t).count();
+
+        if (n > 0)
+            readahead.consumed((size_t) n);
+
+        std::unique_lock<std::mutex> lock(res.mtx);
+
+        res.lat.push_back(ms);
+        res.hits += hit;
+        res.stalls += ms >= stall_ms;
+        res.failed += n <= 0 && !(r.flags & TraceRecord::FLAG_FAILED);
+        res.lag_ms = std::max(res.lag_ms,
+            std::chrono::duration<double, std::milli>(now - due).count());
+    }
+}
+
+int
+main(int argc, char* argv[])
+{
+    std::string path;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--seeders" && i + 1 < argc) {
+            seeders = std::stoi(argv[++i]);
+        } else if (arg == "--piece-size" && i + 1 < argc) {
+            piece_size = std::stoi(argv[++i]) * kB;
+        } else if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (arg == "--speed" && i + 1 < argc) {
+            speed = std::max(std::stod(argv[++i]), 0.01);
+        } else if (arg == "--stall-ms" && i + 1 < argc) {
+            stall_ms = std::stod(argv[++i]);
+        } else if (path.empty() && arg.compare(0, 2, "--") != 0) {
+            path = arg;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+
+    if (path.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--seeders N] [--piece-size kB] [--dir PATH]"
+                     " [--speed X] [--stall-ms MS] TRACE"
+                  << std::endl;
+        return -1;
+    }
+
+    try {
+        auto records = read_trace(path);
+
+        // Every file needs to cover the furthest read in it
+        std::map<int, int64_t> ends;
+        std::map<uint16_t, std::vector<TraceRecord>> streams;
+        std::vector<double> recorded;
+        int recorded_hits = 0;
+
+        for (auto& r : records) {
+            auto& end = ends[r.file];
+            end = std::max(end, r.offset + (int64_t) r.size);
+
+            streams[r.stream].push_back(r);
+
+            if (r.flags & TraceRecord::FLAG_SEEK)
+                continue;
+
+            recorded.push_back((double) r.latency_us / 1000);
+            recorded_hits += (r.flags & TraceRecord::FLAG_HIT) != 0;
+        }
+
+        if (recorded.empty())
+            throw std::runtime_error("No reads in trace");
+
+        std::vector<int64_t> sizes;
+        for (auto& e : ends)
+            sizes.push_back(std::max(e.second, (int64_t) 1));
+
+        std::string seed_path = dir + "/seed";
+        std::string dl_path = dir + "/download";
+
+        auto md = make_torrent(seed_path, "tracereplay", sizes, piece_size);
+
+        Swarm swarm(seeders, md, seed_path);
+
+        auto d = Download::get_download(md.data(), md.size(), dl_path, false);
+
+        // Files are sorted by name in the torrent, so look them up
+        std::map<int, int> files;
+        int n = 0;
+        for (auto& e : ends) {
+            std::string name = sizes.size() == 1
+                ? std::string("tracereplay")
+                : "tracereplay/" + std::to_string(n) + ".bin";
+
+            files[e.first] = d->get_file(name).first;
+            d->open_file(files[e.first]);
+            n++;
+        }
+
+        swarm.connect(Session::get()->listen_port());
+
+        Result res;
+        auto t0 = clock_type::now();
+
+        std::vector<std::thread> threads;
+        for (auto& s : streams)
+            threads.emplace_back(replay, d, std::cref(s.second),
+                std::cref(files), t0, std::ref(res));
+
+        for (auto& t : threads)
+            t.join();
+
+        report("streams", (double) streams.size());
+        report("reads", (double) res.lat.size());
+        report("hits", res.hits);
+        report("recorded_hits", recorded_hits);
+        report("stalls", res.stalls);
+        report("failed", res.failed);
+        report("read_p50_ms", percentile(res.lat, 50));
+        report("read_p99_ms", percentile(res.lat, 99));
+        report("recorded_p50_ms", percentile(recorded, 50));
+        report("recorded_p99_ms", percentile(recorded, 99));
+        report("lag_ms", res.lag_ms);
+    } catch (std::runtime_error& e) {
+        std::cout << "TRACEREPLAY FAIL " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "TRACEREPLAY END" << std::endl;
+
+    return 0;
+}